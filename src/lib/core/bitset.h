@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string.h>
+
+#include "lib/core/types.h"
+
+// Bit sets of arbitrary width, stored as an array of 64-bit words:
+#define BITSET_WORD_COUNT(bit_count) (((bit_count) + 63) >> 6)
+#define BITSET_BIT(bit) ((u64)1 << ((bit) & 63))
+
+#define testBit(bitset, bit)  ((bitset)[(bit) >> 6] &   BITSET_BIT(bit))
+#define setBit(bitset, bit)   ((bitset)[(bit) >> 6] |=  BITSET_BIT(bit))
+#define clearBit(bitset, bit) ((bitset)[(bit) >> 6] &= ~BITSET_BIT(bit))
+
+#define clearBitset(bitset, bit_count) memset(bitset, 0,    sizeof(u64) * BITSET_WORD_COUNT(bit_count))
+#define fillBitset(bitset, bit_count)  memset(bitset, 0xFF, sizeof(u64) * BITSET_WORD_COUNT(bit_count))
+
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+bool anyBit(u64 *bitset, u32 bit_count) {
+    for (u32 i = 0; i < BITSET_WORD_COUNT(bit_count); i++) if (bitset[i]) return true;
+    return false;
+}
@@ -326,9 +326,9 @@ void drawColorControl() {
     vec3 color;
     color.z = 0;
     f32 step = 1.0f / (f32)CONTROL__SLIDER_RANGE;
-    u32 pixel_index_start = frame_buffer.dimentions.width * main_rect.y_range.max;
+    u32 pixel_index_start = frame_buffer.stride * main_rect.y_range.max;
     u32 pixel_index;
-    for (y = 0; y < CONTROL__SLIDER_RANGE; y++, color.z += step, pixel_index_start -= frame_buffer.dimentions.width) {
+    for (y = 0; y < CONTROL__SLIDER_RANGE; y++, color.z += step, pixel_index_start -= frame_buffer.stride) {
         RGB.color.B = (u8)(255.0f * gammaCorrected(color.z));
 
         color.x = 0;
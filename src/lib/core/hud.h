@@ -4,12 +4,14 @@
 #include "lib/core/str.h"
 #include "lib/globals/app.h"
 #include "lib/globals/display.h"
+#include "lib/globals/raytracing.h"
 #include "lib/input/keyboard.h"
 #include "lib/nodes/scene.h"
 
 inline void setCountersInHUD(Timer *timer) {
     printNumberIntoString(timer->average_frames_per_second, hud.fps);
     printNumberIntoString(timer->average_microseconds_per_frame, hud.msf);
+    printNumberIntoString((u16)(ray_tracer.ray_stats.megarays_per_second + 0.5), hud.mrays);
 }
 
 inline void setDimesionsInHUD() {
@@ -24,6 +26,7 @@ inline void setRenderModeInHUD() {
         case Beauty : *mode++ = 'B'; *mode++ = 'e'; *mode++ = 'a'; *mode++ = 'u'; *mode++ = 't'; *mode = 'y'; break;
         case Depth  : *mode++ = ' '; *mode++ = 'D'; *mode++ = 'e'; *mode++ = 'p'; *mode++ = 't'; *mode = 'h'; break;
         case UVs    : *mode++ = 'T'; *mode++ = 'e'; *mode++ = 'x'; *mode++ = 'C'; *mode++ = 'o'; *mode = 'r'; break;
+        case Cost   : *mode++ = ' '; *mode++ = ' '; *mode++ = 'C'; *mode++ = 'o'; *mode++ = 's'; *mode = 't'; break;
     }
 }
 
@@ -42,6 +45,7 @@ void initHUD() {
                          "Using  :  3__\n"
                          "FPS    : ___4\n"
                          "mic-s/f: ___5\n"
+                         "Mrays/s: ___7\n"
                          "Mode : 6_____\n";
 
     char* HUD_char = str_template;
@@ -55,6 +59,7 @@ void initHUD() {
             case '4':  hud.fps    = HUD_text_char; break;
             case '5':  hud.msf    = HUD_text_char; break;
             case '6':  hud.mode   = HUD_text_char; break;
+            case '7':  hud.mrays  = HUD_text_char; break;
         }
 
         *HUD_text_char++ = *HUD_char++;
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <stdio.h>
+#include <string.h>
+
 #include "lib/core/types.h"
 #include "lib/globals/timers.h"
 #include "lib/core/str.h"
+#include "lib/core/trace.h"
 #include "lib/memory/allocators.h"
 
 
@@ -81,4 +85,91 @@ inline void endFrameTimer(Timer *timer, bool increment_frame_count) {
     timer->ticks_after = getTicks();
     accumulateTimer(timer, increment_frame_count);
     if (timer->accumulated_ticks >= ticks_per_second) averageTimer(timer);
-}
\ No newline at end of file
+}
+
+// Profiler scopes cost a predictable branch while neither profiling nor tracing, and nothing when compiled out:
+#ifdef NO_PROFILER
+    #define profileBegin(scope_id)
+    #define profileEnd(scope_id)
+    #define profileFrame()
+#else
+    #define isProfiling() (profiler.is_enabled || trace_recorder.is_recording)
+    #define profileBegin(scope_id) { if (isProfiling()) beginProfileScope(scope_id); }
+    #define profileEnd(scope_id)   { if (isProfiling()) endProfileScope(scope_id); }
+    #define profileFrame()         { if (isProfiling()) startProfileFrame(); else profiler.stack_size = 0; }
+#endif
+
+void beginProfileScope(enum ProfileScopeId scope_id) {
+    if (profiler.stack_size == PROFILE_MAX_DEPTH) return;
+
+    ProfileScope *scope = profiler.scopes + scope_id;
+    scope->depth = profiler.stack_size;
+    profiler.stack[profiler.stack_size++] = (u8)scope_id;
+    scope->ticks_before = getTicks();
+}
+
+void endProfileScope(enum ProfileScopeId scope_id) {
+    u64 ticks = getTicks();
+    if (!profiler.stack_size || profiler.stack[profiler.stack_size - 1] != scope_id) return; // Begun while disabled
+
+    ProfileScope *scope = profiler.scopes + scope_id;
+    scope->frame_ticks += ticks - scope->ticks_before;
+    scope->is_entered = true;
+    profiler.stack_size--;
+
+    if (trace_recorder.is_recording) recordTraceEvent(0, (u8)scope_id, 0, scope->ticks_before, ticks);
+}
+
+// Ends the previous frame (adding the ticks of its scopes to their histories) and begins the next one:
+void startProfileFrame() {
+    if (profiler.stack_size) endProfileScope(ProfileFrame);
+    profiler.stack_size = 0;
+
+    ProfileScope *scope = profiler.scopes;
+    for (u8 i = 0; i < PROFILE_SCOPE_COUNT; i++, scope++) {
+        if (!scope->is_entered) continue;
+
+        scope->history[scope->history_index] = scope->frame_ticks;
+        scope->history_index = (scope->history_index + 1) % PROFILE_HISTORY_LENGTH;
+        if (scope->history_count < PROFILE_HISTORY_LENGTH) scope->history_count++;
+        scope->frame_ticks = 0;
+        scope->is_entered = false;
+    }
+
+    beginProfileScope(ProfileFrame);
+}
+
+void updateProfileScopeStats(ProfileScope *scope) {
+    u64 sorted[PROFILE_HISTORY_LENGTH], ticks, total_ticks = 0;
+    u32 count = scope->history_count, j;
+    if (!count) return;
+
+    for (u32 i = 0; i < count; i++) {
+        ticks = scope->history[i];
+        total_ticks += ticks;
+        for (j = i; j && sorted[j - 1] > ticks; j--) sorted[j] = sorted[j - 1];
+        sorted[j] = ticks;
+    }
+
+    scope->min_microseconds     = microseconds_per_tick * (f64)sorted[0];
+    scope->average_microseconds = microseconds_per_tick * (f64)total_ticks / (f64)count;
+    scope->p99_microseconds     = microseconds_per_tick * (f64)sorted[(count * 99 + 99) / 100 - 1];
+}
+
+// Formats the stats of the scopes entered so far into the profiler's text, a line per scope indented by its depth:
+void updateProfileText() {
+    char *text = profiler.text;
+    u32 length = (u32)snprintf(text, PROFILE_TEXT_LENGTH, "%-14s %8s %8s %8s\n", "Scope (us)", "min", "avg", "p99");
+
+    ProfileScope *scope = profiler.scopes;
+    for (u8 i = 0; i < PROFILE_SCOPE_COUNT && length < PROFILE_TEXT_LENGTH; i++, scope++) {
+        if (!scope->history_count) continue;
+
+        updateProfileScopeStats(scope);
+        length += (u32)snprintf(text + length, PROFILE_TEXT_LENGTH - length, "%*s%-*s %8.0f %8.0f %8.0f\n",
+                           2 * scope->depth, "", 14 - 2 * scope->depth, PROFILE_SCOPE_NAMES[i],
+                           scope->min_microseconds,
+                           scope->average_microseconds,
+                           scope->p99_microseconds);
+    }
+}
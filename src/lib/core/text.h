@@ -16,9 +16,9 @@ void drawText(FrameBuffer* fb, char *str, u32 color, int x, int y) {
     u16 current_x = x;
     u16 current_y = y;
     u16 t_offset = 0;
-    u16 pixel_line_step = fb->dimentions.width - FONT_WIDTH;
-    u32 char_line_step  = fb->dimentions.width * LINE_HEIGHT;
-    Pixel* pixel = fb->pixels + fb->dimentions.width * y + x;;
+    u32 pixel_line_step = fb->stride - FONT_WIDTH;
+    u32 char_line_step  = fb->stride * LINE_HEIGHT;
+    Pixel* pixel = fb->pixels + fb->stride * y + x;;
     Pixel* character_pixel;
     u8* byte;
     char character = *str;
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "lib/core/types.h"
+#include "lib/core/trace.h"
+
+#define MAX_WORKER_COUNT 64
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+
+    typedef HANDLE Thread;
+    typedef CRITICAL_SECTION Mutex;
+    typedef CONDITION_VARIABLE ConditionVariable;
+    #define THREAD_PROC(name, arg) DWORD WINAPI name(LPVOID arg)
+    #define THREAD_PROC_RETURN return 0
+
+    #define initMutex(mutex) InitializeCriticalSection(mutex)
+    #define lockMutex(mutex) EnterCriticalSection(mutex)
+    #define unlockMutex(mutex) LeaveCriticalSection(mutex)
+    #define initConditionVariable(cv) InitializeConditionVariable(cv)
+    #define waitConditionVariable(cv, mutex) SleepConditionVariableCS(cv, mutex, INFINITE)
+    #define signalConditionVariable(cv) WakeConditionVariable(cv)
+    #define broadcastConditionVariable(cv) WakeAllConditionVariable(cv)
+    #define startThread(thread, proc, arg) (*(thread) = CreateThread(0, 0, proc, arg, 0, 0))
+    #define atomicIncrement(value) ((u32)InterlockedIncrement((volatile LONG*)(value)))
+    #define atomicAdd(value, amount) ((u32)InterlockedExchangeAdd((volatile LONG*)(value), (LONG)(amount)) + (u32)(amount))
+
+    u32 getCoreCount() {
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        return (u32)system_info.dwNumberOfProcessors;
+    }
+#else
+    #include <unistd.h>
+    #include <pthread.h>
+
+    typedef pthread_t Thread;
+    typedef pthread_mutex_t Mutex;
+    typedef pthread_cond_t ConditionVariable;
+    #define THREAD_PROC(name, arg) void* name(void *arg)
+    #define THREAD_PROC_RETURN return 0
+
+    #define initMutex(mutex) pthread_mutex_init(mutex, 0)
+    #define lockMutex(mutex) pthread_mutex_lock(mutex)
+    #define unlockMutex(mutex) pthread_mutex_unlock(mutex)
+    #define initConditionVariable(cv) pthread_cond_init(cv, 0)
+    #define waitConditionVariable(cv, mutex) pthread_cond_wait(cv, mutex)
+    #define signalConditionVariable(cv) pthread_cond_signal(cv)
+    #define broadcastConditionVariable(cv) pthread_cond_broadcast(cv)
+    #define startThread(thread, proc, arg) pthread_create(thread, 0, proc, arg)
+    #define atomicIncrement(value) __sync_add_and_fetch(value, 1)
+    #define atomicAdd(value, amount) __sync_add_and_fetch(value, amount)
+
+    u32 getCoreCount() {
+        long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+        return core_count > 0 ? (u32)core_count : 1;
+    }
+#endif
+
+typedef void (*Job)(u32 job_id, u32 worker_id);
+
+// A persistent pool of workers that drain a shared job counter.
+// The dispatching thread takes part as worker 0, the pool threads are workers 1..worker_count-1
+typedef struct {
+    Thread threads[MAX_WORKER_COUNT];
+    Mutex mutex;
+    ConditionVariable work_ready,
+                      work_done;
+    Job job;
+    volatile u32 next_job_id,
+                 job_count,
+                 busy_worker_count,
+                 generation;
+    u32 worker_count;
+} WorkerPool;
+WorkerPool worker_pool;
+
+typedef struct {
+    WorkerPool *pool;
+    u32 worker_id;
+} Worker;
+Worker workers[MAX_WORKER_COUNT];
+_thread_local u32 current_worker_id; // The main thread is worker 0
+
+inline void runJob(Job job, u32 job_id, u32 worker_id) {
+    if (!trace_recorder.is_recording) {
+        job(job_id, worker_id);
+        return;
+    }
+
+    u64 start_ticks = getTicks();
+    job(job_id, worker_id);
+    recordTraceEvent(worker_id, TraceJob, job_id, start_ticks, getTicks());
+}
+
+inline void runJobs(WorkerPool *pool, u32 worker_id) {
+    u32 job_id;
+    while ((job_id = atomicIncrement(&pool->next_job_id) - 1) < pool->job_count)
+        runJob(pool->job, job_id, worker_id);
+}
+
+THREAD_PROC(runWorker, arg) {
+    Worker *worker = (Worker*)arg;
+    WorkerPool *pool = worker->pool;
+    u32 generation = 0;
+    current_worker_id = worker->worker_id;
+
+    while (true) {
+        lockMutex(&pool->mutex);
+        while (generation == pool->generation)
+            waitConditionVariable(&pool->work_ready, &pool->mutex);
+        generation = pool->generation;
+        unlockMutex(&pool->mutex);
+
+        runJobs(pool, worker->worker_id);
+
+        lockMutex(&pool->mutex);
+        if (!--pool->busy_worker_count)
+            signalConditionVariable(&pool->work_done);
+        unlockMutex(&pool->mutex);
+    }
+
+    THREAD_PROC_RETURN;
+}
+
+void initWorkerPool(WorkerPool *pool, u32 worker_count) {
+    if (worker_count > MAX_WORKER_COUNT) worker_count = MAX_WORKER_COUNT;
+    if (!worker_count) worker_count = 1;
+
+    pool->worker_count = worker_count;
+    pool->generation = 0;
+    pool->job_count = 0;
+    pool->next_job_id = 0;
+    pool->busy_worker_count = 0;
+    initMutex(&pool->mutex);
+    initConditionVariable(&pool->work_ready);
+    initConditionVariable(&pool->work_done);
+
+    for (u32 i = 1; i < worker_count; i++) {
+        workers[i].pool = pool;
+        workers[i].worker_id = i;
+        startThread(pool->threads + i, runWorker, workers + i);
+    }
+}
+
+// Runs job(0..job_count-1) across the pool and returns once all jobs are done:
+void dispatchJobs(WorkerPool *pool, Job job, u32 job_count) {
+    if (pool->worker_count == 1) {
+        for (u32 job_id = 0; job_id < job_count; job_id++) runJob(job, job_id, 0);
+        return;
+    }
+
+    lockMutex(&pool->mutex);
+    pool->job = job;
+    pool->job_count = job_count;
+    pool->next_job_id = 0;
+    pool->busy_worker_count = pool->worker_count - 1;
+    pool->generation++;
+    broadcastConditionVariable(&pool->work_ready);
+    unlockMutex(&pool->mutex);
+
+    runJobs(pool, 0);
+
+    lockMutex(&pool->mutex);
+    while (pool->busy_worker_count)
+        waitConditionVariable(&pool->work_done, &pool->mutex);
+    unlockMutex(&pool->mutex);
+}
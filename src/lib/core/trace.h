@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "lib/core/types.h"
+#include "lib/globals/timers.h"
+#include "lib/memory/allocators.h"
+
+// The rings are allocated on the first recording, and reused by later ones:
+void startTraceRecording(u32 thread_count) {
+    TraceRecorder *recorder = &trace_recorder;
+    if (!recorder->rings) {
+        recorder->thread_count = thread_count;
+        recorder->rings = AllocN(TraceRing, thread_count);
+        for (u32 i = 0; i < thread_count; i++)
+            recorder->rings[i].events = AllocN(TraceEvent, TRACE_EVENTS_PER_THREAD);
+    }
+
+    for (u32 i = 0; i < recorder->thread_count; i++)
+        recorder->rings[i].next_index = recorder->rings[i].count = 0;
+
+    recorder->start_ticks = getTicks();
+    recorder->is_recording = true;
+}
+
+// Only the given thread may append to its ring:
+inline void recordTraceEvent(u32 thread_id, u8 name_id, u32 job_id, u64 start_ticks, u64 end_ticks) {
+    TraceRing *ring = trace_recorder.rings + thread_id;
+    TraceEvent *event = ring->events + ring->next_index;
+    event->start_ticks = start_ticks;
+    event->duration_ticks = end_ticks - start_ticks;
+    event->job_id = job_id;
+    event->name_id = name_id;
+
+    ring->next_index = (ring->next_index + 1) % TRACE_EVENTS_PER_THREAD;
+    if (ring->count < TRACE_EVENTS_PER_THREAD) ring->count++;
+}
+
+void stopTraceRecording() {
+    trace_recorder.is_recording = false;
+}
+
+// Writes the recorded events in the Chrome trace JSON format (loadable in chrome://tracing or Perfetto),
+// with microsecond timestamps relative to the start of the recording:
+bool writeTrace(char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+
+    TraceRecorder *recorder = &trace_recorder;
+    TraceRing *ring = recorder->rings;
+    TraceEvent *event;
+    u32 index;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+    for (u32 thread_id = 0; thread_id < recorder->thread_count; thread_id++, ring++) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+                thread_id ? ",\n" : "", thread_id, thread_id ? "Worker" : "Main / worker", thread_id);
+
+        index = (ring->next_index + TRACE_EVENTS_PER_THREAD - ring->count) % TRACE_EVENTS_PER_THREAD;
+        for (u32 i = 0; i < ring->count; i++, index = (index + 1) % TRACE_EVENTS_PER_THREAD) {
+            event = ring->events + index;
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                    event->name_id == TraceJob ? "Job" : PROFILE_SCOPE_NAMES[event->name_id], thread_id,
+                    microseconds_per_tick * ((f64)event->start_ticks - (f64)recorder->start_ticks),
+                    microseconds_per_tick * (f64)event->duration_ticks);
+            if (event->name_id == TraceJob) fprintf(file, ",\"args\":{\"id\":%u}", event->job_id);
+            fputc('}', file);
+        }
+    }
+    fputs("\n]}\n", file);
+
+    bool is_written = !ferror(file);
+    return !fclose(file) && is_written;
+}
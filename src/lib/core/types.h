@@ -32,6 +32,14 @@ typedef void (*CallBack)();
     #error "Please provide a definition for _align macro for your host compiler!"
 #endif
 
+#if defined(__GNUC__) // GCC (and NVCC's host compiler)
+    #define _thread_local __thread
+#elif defined(_MSC_VER) // MSVC
+    #define _thread_local __declspec(thread)
+#else
+    #error "Please provide a definition for _thread_local macro for your host compiler!"
+#endif
+
 
 // Math:
 // ====
@@ -39,6 +47,11 @@ typedef void (*CallBack)();
 #define SQRT2 1.41421356237f
 #define SQRT3 1.73205080757f
 
+#if !defined(__CUDACC__) && !defined(min) // <windows.h> provides these on Win32
+    #define min(a, b) ((a) < (b) ? (a) : (b))
+    #define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
 typedef struct { i32 x, y;    } vec2i;
 typedef struct { f32 x, y;    } vec2;
 typedef struct { f32 x, y, z; } vec3;
@@ -26,26 +26,61 @@
 #include "lib/shapes/helix.h"
 
 #include "lib/memory/allocators.h"
+#include "lib/memory/worker_allocators.h"
 
 #include "lib/render/raytracer.h"
+#include "lib/render/dynamic_resolution.h"
+
+#include "lib/nodes/scene_file.h"
 
 char* getTitle() {
     return RAY_TRACER_TITLE;
 }
 
+#define TRACE_FILE_PATH "trace.json"
+
 #define SPHERE_TURN_SPEED 0.3f
 #define TETRAHEDRON_TURN_SPEED 0.3f
 
 void updateAndRender() {
+    resetMemory(&frame_memory);
+    resetWorkerMemory();
+    // Toggling a recording off writes it out:
+    if (trace_recording_toggled) {
+        trace_recording_toggled = false;
+        if (!trace_recorder.is_recording)
+            startTraceRecording(worker_pool.worker_count);
+        else {
+            stopTraceRecording();
+            printDebugString(writeTrace(TRACE_FILE_PATH) ? "Trace written to " TRACE_FILE_PATH "\n" : "Could not write the trace\n");
+        }
+    }
+    profileFrame();
     setRunOnInHUD();
     setRenderModeInHUD();
 
     startFrameTimer(&update_timer);
+    if (is_idle) update_timer.delta_time = 0; // The time since the last frame went into waiting for input
+
+    // The scene gets updated and rendered at the render resolution (see DynamicResolution):
+    if (dynamic_resolution.scale < 1) swapFrameBuffers();
 
-    yawMat3(update_timer.delta_time * SPHERE_TURN_SPEED, &main_scene.spheres[1].rotation);
+    profileBegin(ProfileAnimation);
 
+    // The demo's animation is paused while accumulating, as it would restart the accumulation every frame:
+    if (main_scene.sphere_count > 1 && !accumulate) {
+        yawMat3(update_timer.delta_time * SPHERE_TURN_SPEED, &main_scene.spheres[1].rotation);
+        invalidateGeometry(&main_scene, GeoTypeSphere, 1);
+    }
+    profileEnd(ProfileAnimation);
+
+    profileBegin(ProfileInput);
     if (mouse_wheel_scrolled) {
-       if (shift_is_pressed) {
+       if (shift_is_pressed && main_scene.cube_count && main_scene.tetrahedron_count) {
+           // Invalidated before and after resizing, as they get smaller or larger:
+           invalidateGeometry(&main_scene, GeoTypeTetrahedron, 0);
+           invalidateGeometry(&main_scene, GeoTypeCube, 0);
+
            Node *node = &main_scene.tetrahedra->node;
            f32 radius = node->radius + mouse_wheel_scroll_amount / 1000;
            setNodeRadius(node, radius);
@@ -60,7 +95,13 @@ void updateAndRender() {
            b = ray_tracer.ssb.bounds.cubes;
            computeSSB(b, p->x, p->y, p->z, main_scene.cubes->node.radius, main_camera.focal_length);
 
-           updateBVH(&ray_tracer.bvh, &main_scene);
+           Node *resized_nodes[2] = {&main_scene.tetrahedra->node, node};
+           profileBegin(ProfileBVHUpdate);
+           refitBVH(&ray_tracer.bvh, &main_scene, resized_nodes, 2);
+           profileEnd(ProfileBVHUpdate);
+           invalidateGeometry(&main_scene, GeoTypeTetrahedron, 0);
+           invalidateGeometry(&main_scene, GeoTypeCube, 0);
+           restartAccumulation();
            mouse_wheel_scroll_amount = 0;
            mouse_wheel_scrolled = false;
 #ifdef __CUDACC__
@@ -70,13 +111,24 @@ void updateAndRender() {
        } else
             current_camera_controller->onMouseWheelScrolled();
     }
+    profileEnd(ProfileInput);
 
+    profileBegin(ProfileAnimation);
     f32 amount = update_timer.delta_time * TETRAHEDRON_TURN_SPEED;
     xform3 local_xform;
     initXform3(&local_xform);
     rotateXform3(&local_xform, amount, amount/2, amount/3);
-    rotateNode(&main_scene.cubes->node, &local_xform.rotation_matrix);
-    rotateNode(&main_scene.tetrahedra->node, &local_xform.rotation_matrix);
+    if (!accumulate) {
+        if (main_scene.cube_count) {
+            rotateNode(&main_scene.cubes->node, &local_xform.rotation_matrix);
+            invalidateGeometry(&main_scene, GeoTypeCube, 0);
+        }
+        if (main_scene.tetrahedron_count) {
+            rotateNode(&main_scene.tetrahedra->node, &local_xform.rotation_matrix);
+            invalidateGeometry(&main_scene, GeoTypeTetrahedron, 0);
+        }
+    }
+    profileEnd(ProfileAnimation);
 
 #ifdef __CUDACC__
     gpuErrchk(cudaMemcpyToSymbol(d_cubes, main_scene.cubes, sizeof(Cube) * CUBE_COUNT, 0, cudaMemcpyHostToDevice));
@@ -84,6 +136,7 @@ void updateAndRender() {
     gpuErrchk(cudaMemcpyToSymbol(d_tetrahedra, main_scene.tetrahedra, sizeof(Tetrahedron) * TETRAHEDRON_COUNT, 0, cudaMemcpyHostToDevice));
 #endif
 
+    profileBegin(ProfileInput);
     if (color_control.is_visible) {
         if (left_mouse_button.is_pressed && !color_control.is_controlled) {
             if (inBounds(&color_control.R, mouse_pos)) {
@@ -189,6 +242,8 @@ void updateAndRender() {
             }
 
             mouse_movement.x = mouse_movement.y = 0;
+            restartAccumulation();
+            invalidateLighting();
 
 #ifdef __CUDACC__
             if (light_selector.is_ambient_selected)
@@ -199,35 +254,72 @@ void updateAndRender() {
         } else
             current_camera_controller->onMouseMoved();
     }
-    current_camera_controller->onUpdate();
+    profileEnd(ProfileInput);
 
+    profileBegin(ProfileControllerUpdate);
+    current_camera_controller->onUpdate();
     if (current_camera_controller->zoomed) onZoom();
     if (current_camera_controller->turned) onTurn();
-    if (current_camera_controller->moved)  onMove(&main_scene);
+    profileEnd(ProfileControllerUpdate);
 
+    if (current_camera_controller->moved) {
+        profileBegin(ProfileSSB);
+        onMove(&main_scene);
+        profileEnd(ProfileSSB);
+    }
+
+    if (mouse_double_clicked) {
+        mouse_double_clicked = false;
+        bool in_fps_mode = current_camera_controller == &fps_camera_controller.controller;
+        current_camera_controller = in_fps_mode ?
+                                    &orb_camera_controller.controller :
+                                    &fps_camera_controller.controller;
+    }
+
+    // Frames that would show the same as the last one are skipped (unless samples are still being accumulated, or the
+    // last frame reconstructed pixels that were not traced), while profiling they keep getting rendered to be measured.
+    // Accumulating adds rays_per_pixel (1) samples per frame, so idling starts MAX_ACCUMULATED_SAMPLE_COUNT frames in:
+    is_idle = skip_unchanged_frames && !frame_changes && !profiler.is_enabled && !trace_recorder.is_recording &&
+              !(accumulate && render_mode != Cost && ray_tracer.accumulation.sample_count < MAX_ACCUMULATED_SAMPLE_COUNT) &&
+              !(checkerboard_rendering && !ray_tracer.checkerboard.is_complete);
+    if (is_idle) {
+        if (dynamic_resolution.is_swapped) swapFrameBuffers();
+        return;
+    }
+
+    profileBegin(ProfileRender);
+    u64 render_ticks = getTicks();
     onRender(&main_scene, &main_camera);
+    if (dynamic_resolution.is_swapped) {
+        swapFrameBuffers();
+        upscaleFrame();
+    }
+    updateRenderScale(getTicks() - render_ticks);
+    profileEnd(ProfileRender);
 
     endFrameTimer(&update_timer, true);
+    profileBegin(ProfileOverlays);
     if (hud.is_visible) {
         if (!update_timer.accumulated_frame_count) setCountersInHUD(&update_timer);
         drawText(&frame_buffer, hud.text, HUD_COLOR, frame_buffer.dimentions.width - HUD_RIGHT - HUD_WIDTH, HUD_TOP);
     }
+    if (profiler.is_enabled) {
+        if (!update_timer.accumulated_frame_count) updateProfileText();
+        drawText(&frame_buffer, profiler.text, HUD_COLOR, HUD_LEFT, HUD_TOP);
+    }
+    if (render_mode == Cost) drawCostLegend();
     if (color_control.is_visible) drawColorControl();
     if (light_controlls.is_visible) drawLightControls();
     if (light_selector.is_visible) drawLightSelector();
-
-    if (mouse_double_clicked) {
-        mouse_double_clicked = false;
-        bool in_fps_mode = current_camera_controller == &fps_camera_controller.controller;
-        current_camera_controller = in_fps_mode ?
-                                    &orb_camera_controller.controller :
-                                    &fps_camera_controller.controller;
-    }
+    profileEnd(ProfileOverlays);
+    frame_changes = 0;
 }
 
 void resize(u16 width, u16 height) {
-    updateFrameBufferDimensions(width, height);
+    frame_changes |= SETTINGS_CHANGED;
+    resizeFrameBuffer(width, height);
     onResize(&main_scene);
+    trimMemory(&pixel_memory);
     setDimesionsInHUD();
     u32 controls_y = frame_buffer.dimentions.height - 40 - CONTROL__SLIDER_LENGTH * 2;
     setColorControlPosition(color_control.position.x, controls_y);
@@ -244,13 +336,15 @@ void initEngine(
     KeyMap key_map
 ) {
     keys = key_map;
+    initMemory(&frame_memory, allocate(FRAME_MEMORY_SIZE), FRAME_MEMORY_SIZE);
     updateWindowTitle = platformUpdateWindowTitle;
     printDebugString  = platformPrintDebugString;
     initAppGlobals();
     initMouse();
     initTimers(platformGetTicks, platformTicksPerSecond);
     initFrameBuffer();
-    initScene(&main_scene);
+    if (!scene_file.data || !loadSceneFile(&main_scene, &ray_tracer.bvh, scene_file.data, scene_file.size))
+        initScene(&main_scene);
     initCamera(&main_camera);
     initFpsController(&main_camera);
     initOrbController(&main_camera);
@@ -3,27 +3,45 @@
 
 #include "lib/core/types.h"
 
-#define MAX_WIDTH 3840
-#define MAX_HEIGHT 2160
-
-#define PIXEL_SIZE 4
-#define RENDER_SIZE Megabytes(8 * PIXEL_SIZE)
-
 #define HUD_LENGTH 140
 
 bool is_running = true;
+bool is_idle = false; // The last update skipped rendering, as nothing changed (platforms wait for input meanwhile)
+bool skip_unchanged_frames = true; // Updates render only when something changed (see frame_changes)
 bool use_GPU = true;
 bool show_BVH = false;
 bool show_SSB = false;
+bool accumulate = false; // Progressive accumulation of anti-aliased samples (pauses the demo's animation)
+bool render_changes_only = true; // While the camera is still, only trace the regions of the frame that changed
+bool reproject_shading = true; // While the camera moves, reuse the colors of the surfaces the last frame showed (Beauty mode)
+bool checkerboard_rendering = false; // Trace half of the pixels of each frame, reconstructing the others (see Checkerboard)
+
+// What changed since the last frame was rendered. Updates that find nothing changed leave the last frame presented
+// (see updateAndRender). Input marks the changes as it comes in, as do the ray tracer's invalidations:
+#define SCENE_CHANGED 1
+#define CAMERA_CHANGED 2
+#define OVERLAYS_CHANGED 4
+#define SETTINGS_CHANGED 8 // Of rendering or of the frame's size
+u8 frame_changes = SETTINGS_CHANGED;
 
 enum RenderMode {
     Normals,
     Beauty,
     Depth,
-    UVs
+    UVs,
+    Cost
 };
 enum RenderMode render_mode = Beauty;
 
+// The counter the Cost mode shows as a heatmap (see RayCost):
+enum CostMetric {
+    CostIntersectionTests,
+    CostBVHNodesVisited,
+    CostShadowRays
+};
+#define COST_METRIC_COUNT 3
+enum CostMetric cost_metric = CostIntersectionTests;
+
 #ifdef __CUDACC__
     #define CUDA_MAX_THREADS 1024
 
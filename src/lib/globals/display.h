@@ -3,16 +3,19 @@
 #include <math.h>
 
 #include "lib/core/types.h"
+#include "lib/memory/allocators.h"
 
-#define MAX_WIDTH 3840
-#define MAX_HEIGHT 2160
+// Up to 8K, the per-pixel buffers are sized to the actual frame (see resizeFrameBuffer):
+#define MAX_WIDTH 7680
+#define MAX_HEIGHT 4320
 
-#define PIXEL_SIZE 4
-#define RENDER_SIZE Megabytes(8 * PIXEL_SIZE)
+#define INITIAL_WIDTH 640
+#define INITIAL_HEIGHT 480
 
 #define HUD_LENGTH 140
 #define HUD_WIDTH 12
 #define HUD_RIGHT 100
+#define HUD_LEFT 10
 #define HUD_TOP 10
 
 typedef struct {
@@ -23,6 +26,7 @@ typedef struct {
          *run_on,
          *fps,
          *msf,
+         *mrays,
          *mode;
 } HUD;
 HUD hud;
@@ -83,14 +87,44 @@ typedef union {
     u32 value;
 } Pixel;
 
+// Rows are padded to a cache line, so the pixel below another is stride pixels after it
+// (the per-pixel buffers of the renderers share this layout):
+#define FRAME_BUFFER_ROW_ALIGNMENT (PIXEL_MEMORY_ALIGNMENT / sizeof(Pixel))
+
 typedef struct FrameBuffer {
     Dimentions dimentions;
+    u32 stride,
+        size; // Pixels, including the padding of the rows
     Pixel* pixels;
 } FrameBuffer;
 FrameBuffer frame_buffer;
 
+// Dynamic resolution: Given a target frame time, frames get rendered at a fraction of the window's resolution, picked
+// from the time the last ones took (see updateRenderScale). They are rendered into a frame buffer of their own that is
+// then upscaled into the frame buffer. While updating the scene and rendering the two are swapped, so that the renderers
+// see the render resolution as the frame's. The scale only changes once the frames take longer than the target, or
+// less than its headroom (changing it invalidates the whole frame):
+#define RENDER_SCALE_STEPS 20 // Scales are multiples of 1 / RENDER_SCALE_STEPS
+#define MIN_RENDER_SCALE_STEPS 5 // A quarter of the window's width and height
+#define RENDER_SCALE_HEADROOM 0.75f // Of the target, the scale grows only once frames take less
+#define RENDER_TIME_SMOOTHING 0.25f // The weight of the last frame in the average time
+#define DEFAULT_TARGET_FRAME_TIME (1000.0f / 30)
+
+typedef struct {
+    FrameBuffer frame_buffer; // At the render resolution (its pixels are allocated at the window's)
+    u32 *columns; // The source column of each of the window's columns, as 24.8 fixed point (see upscaleRows)
+    f32 target_milliseconds, // Zero renders at the window's resolution
+        average_milliseconds, // Of rendering and upscaling the last frames
+        scale;
+    bool is_swapped; // The frame buffer is the one at the render resolution
+} DynamicResolution;
+DynamicResolution dynamic_resolution;
+
 #ifdef __CUDACC__
-    __device__ u32 d_pixels[MAX_WIDTH * MAX_HEIGHT];
+    // Rendered unpadded (width by height) and grown as needed:
+    __device__ u32 *d_pixels;
+    u32 *d_pixels_address;
+    u32 d_pixels_capacity;
     __constant__ Dimentions d_dimentions[1];
 //    __constant__ u8 d_GAMMA_LUT[256];
 #endif
@@ -110,7 +144,31 @@ void updateFrameBufferDimensions(u16 width, u16 height) {
 #endif
 }
 
+// Releases all the per-pixel buffers and reallocates the frame buffer at the new size
+// (the renderers reallocate theirs after it, see onResize):
+void resizeFrameBuffer(u16 width, u16 height) {
+    resetMemory(&pixel_memory);
+    frame_buffer.stride = (width + FRAME_BUFFER_ROW_ALIGNMENT - 1) / FRAME_BUFFER_ROW_ALIGNMENT * FRAME_BUFFER_ROW_ALIGNMENT;
+    frame_buffer.size = frame_buffer.stride * height;
+    frame_buffer.pixels = AllocPixelsN(Pixel, frame_buffer.size);
+    updateFrameBufferDimensions(width, height);
+
+    // Frames start out rendered at the window's resolution (see updateRenderScale):
+    dynamic_resolution.frame_buffer.pixels = AllocPixelsN(Pixel, frame_buffer.size);
+    dynamic_resolution.columns = AllocPixelsN(u32, width);
+    dynamic_resolution.scale = 1;
+    dynamic_resolution.average_milliseconds = 0;
+#ifdef __CUDACC__
+    if (d_pixels_capacity < frame_buffer.dimentions.width_times_height) {
+        if (d_pixels_address) gpuErrchk(cudaFree(d_pixels_address));
+        d_pixels_capacity = frame_buffer.dimentions.width_times_height;
+        gpuErrchk(cudaMalloc((void**)&d_pixels_address, sizeof(u32) * d_pixels_capacity));
+        gpuErrchk(cudaMemcpyToSymbol(d_pixels, &d_pixels_address, sizeof(u32*), 0, cudaMemcpyHostToDevice));
+    }
+#endif
+}
+
 void initFrameBuffer() {
-    frame_buffer.pixels = AllocN(Pixel, RENDER_SIZE);
-    updateFrameBufferDimensions(MAX_WIDTH, MAX_HEIGHT);
-}
\ No newline at end of file
+    initReservedMemory(&pixel_memory, reserveMemory(0, PIXEL_MEMORY_SIZE), PIXEL_MEMORY_SIZE);
+    resizeFrameBuffer(INITIAL_WIDTH, INITIAL_HEIGHT);
+}
@@ -20,6 +20,7 @@ vec2i mouse_pos,
 bool mouse_moved,
      mouse_is_captured,
      mouse_double_clicked,
+     trace_recording_toggled,
      mouse_wheel_scrolled;
 
 f32 mouse_wheel_scroll_amount;
@@ -48,6 +49,11 @@ typedef struct {
        toggle_BVH,
        toggle_SSB,
        toggle_GPU,
+       toggle_accumulation,
+       toggle_profiler,
+       toggle_trace,
+       toggle_dynamic_resolution,
+       toggle_checkerboard,
        alt,
        ctrl,
        shift,
@@ -56,6 +62,8 @@ typedef struct {
        set_beauty,
        set_normal,
        set_depth,
-       set_uvs;
+       set_uvs,
+       set_cost,
+       cycle_cost_metric;
 } KeyMap;
 KeyMap keys;
\ No newline at end of file
@@ -1,13 +1,14 @@
 #pragma once
 
 #include "lib/core/types.h"
+#include "lib/core/bitset.h"
+#include "lib/globals/app.h"
+#include "lib/globals/display.h"
 #include "lib/globals/scene.h"
 
 #define MAX_HIT_DEPTH 4
 #define MAX_DISTANCE 10000
 
-#define FULL_MASK (1 + 2 + 4 + 8)
-
 static char* RAY_TRACER_TITLE = "RayTrace";
 
 typedef struct {
@@ -19,65 +20,258 @@ typedef struct {
     u8 material_id;
 } RayHit;
 
+// A bit per geometry id (see bitset.h), sized to the scene's geometry counts:
 typedef struct {
-    u8 cubes, spheres, tetrahedra;
+    u64 *cubes, *spheres, *tetrahedra, *meshes;
 } GeometryMasks;
 
 typedef struct {
     GeometryMasks visibility, transparency, shadowing;
 } Masks;
 
+// The work done for a pixel, a count per CostMetric. While rendering in Cost mode, each worker points ray_cost
+// at the counters of the pixel it is rendering, for the tracing and shading functions to count into.
+// The Cost mode shades as the Beauty mode does, which traces no secondary rays, so there are no counts of those:
+typedef struct {
+    u32 counts[COST_METRIC_COUNT];
+} RayCost;
+_thread_local RayCost *ray_cost;
+
+// The rays each worker traced (and the primitives it tested them against), padded to a cache line of their own.
+// Workers point ray_counts at theirs, rendering on the GPU is not counted (no mode traces secondary rays, see RayCost):
+typedef struct {
+    u64 primary_rays,
+        shadow_rays,
+        any_hits, // Shadow rays that stopped at the first occluder found
+        primitive_tests,
+        padding[4];
+} RayCounts;
+_thread_local RayCounts *ray_counts;
+
+#ifdef __CUDA_ARCH__
+    #define countRayCost(metric, amount)
+    #define countRays(counter, amount)
+#else
+    #define countRayCost(metric, amount) { if (ray_cost) ray_cost->counts[metric] += (amount); }
+    #define countRays(counter, amount) { if (ray_counts) ray_counts->counter += (amount); }
+#endif
+#define countIntersectionTests(amount) { countRayCost(CostIntersectionTests, amount) countRays(primitive_tests, amount) }
+
 typedef struct {
-    Masks masks;
     RayHit hit;
     vec3 *origin,
-         *direction;
+         *direction,
+         *direction_rcp; // For slab tests against AABBs
 } Ray;
 
 
 typedef struct {
-    Bounds2Di spheres[SPHERE_COUNT], cubes[CUBE_COUNT], tetrahedra[TETRAHEDRON_COUNT];
+    Bounds2Di *spheres, *cubes, *tetrahedra, *meshes;
 } GeometryBounds;
 
 typedef struct {
-    vec3 spheres[SPHERE_COUNT], cubes[CUBE_COUNT], tetrahedra[TETRAHEDRON_COUNT];
+    vec3 *spheres, *cubes, *tetrahedra, *meshes;
 } GeometryViewPositions;
 
+// Ids of geometry, in ascending order:
+typedef struct {
+    u16 *ids, count;
+} GeometryIds;
+
+// The geometry that may be visible within a tile (allocated by the worker rendering it, see allocateTileGeometry):
+typedef struct {
+    GeometryIds cubes, spheres, tetrahedra, meshes;
+    u8 *sphere_lanes, *cube_lanes, *tetrahedron_lanes;
+} TileGeometry;
+
 typedef struct {
     GeometryBounds bounds;
     GeometryViewPositions view_positions;
 } SSB;
 
-#define MAX_BVH_NODE_COUNT 8
+#define MAX_BVH_DEPTH 64
+#define BVH_BIN_COUNT 16
 
+// Flat binary tree: the children of an inner node are stored next to each other (right = left + 1).
+// Leaves hold a single primitive and have no children (the root is never a child).
 typedef struct {
-    u8 children, geo_type, geo_ids;
     AABB aabb;
+    u32 left_child;
+    u16 geo_id;
+    u8 geo_type;
 } BVHNode;
 
+// Also used for building mesh BVHs, where the geometry id is the triangle's:
 typedef struct {
-    u8 node_count;
+    AABB aabb;
+    vec3 centroid;
+    u32 geo_id;
+    u8 geo_type;
+} BVHPrimitive;
+
+// Refitting lets the tree degrade, it gets rebuilt once its SAH cost (summed node areas over the root area)
+// grows this much over the cost it was built with:
+#define BVH_REBUILD_RATIO 1.5f
+
+typedef struct {
+    u32 node_count, primitive_count;
     BVHNode *nodes;
+    BVHPrimitive *primitives; // Only while building (see updateBVH)
+    u32 *parent_ids, *leaf_ids,
+        geo_offsets[GEO_TYPE_COUNT];
+    f32 area_sum, built_cost;
 } BVH;
 
+#define TILE_SIZE 32
+
+typedef struct {
+    vec3 origin,
+         start,
+         right,
+         down;
+    u16 columns, rows;
+    u32 count;
+} Tiles;
+
+// Progressive accumulation: While the camera and the scene are still, every frame adds rays_per_pixel
+// jittered samples to each pixel's color sum, and shows their average.
+// Once enough samples were summed the frame only shows the average:
+#define MAX_RAYS_PER_PIXEL 16
+#define MAX_ACCUMULATED_SAMPLE_COUNT 1024
+
+typedef struct {
+    vec3 *color_sums,
+         ray_direction_offsets[MAX_RAYS_PER_PIXEL]; // The subpixel offsets of the current frame's samples
+    u32 sample_count, // Samples summed so far (zeroed to restart)
+        new_sample_count; // Samples being added by the current frame
+    enum RenderMode render_mode;
+} Accumulation;
+
+typedef struct {
+    RayCost *costs, // Of every pixel of the last frame rendered in Cost mode (allocated on first use)
+            *worker_max_costs, // The highest counts each worker came across (per counter)
+            max_cost;
+} CostMap;
+
+// Dirty regions: While the camera is still, frames only trace the tiles that changed geometry may show up in
+// (see invalidateGeometry), copying the others from the image the last frame rendered:
+typedef struct {
+    Pixel *image; // The last frame as it was rendered (before the overlays were drawn over it)
+    u64 *tiles; // A bit per tile, set for the ones to trace
+    u32 tile_count, // Traced by the last frame
+        tile_bit_count;
+    enum RenderMode render_mode;
+    bool is_full, // All tiles are to be traced (the image is outdated)
+         is_relit; // The lighting changed, so tiles that are not traced get shaded again (from the G-buffer)
+} DirtyRegions;
+
+// Temporal reprojection: While the camera moves (in Beauty mode), each pixel's primary hit is projected to where the
+// last frame's camera saw it, and the color shaded there is reused when the last frame hit the same surface there
+// (of a material that is only Lambert shaded, see reprojectHit). Reused colors age with every frame they are carried
+// over for and get shaded again once too old, as does the whole frame once the camera stops.
+// Every pixel's primary ray is still traced, to check its hit against the last frame's: only the shading is reused:
+#define REPROJECTION_MAX_AGE 8
+#define REPROJECTION_DEPTH_TOLERANCE 0.01f // Off the surface's plane, relative to the hit's distance from the camera
+#define REPROJECTION_NORMAL_TOLERANCE 0.95f // The least cosine between the normals
+#define getReprojectionPhase(x, y) ((u8)(((x) + 2 * (y)) & 3)) // The age shaded colors start at, staggering their expiry
+
+typedef struct {
+    RayHit *last_hits; // The last frame's G-buffer (swapped with the current one by reprojected frames)
+    Pixel *last_image; // The last frame's image (swapped with the one of the dirty regions)
+    u8 *ages, // Frames each pixel's color was carried over for
+       *last_ages;
+    mat3 rotation_inverted; // Of the camera the last frame was rendered from
+    vec3 position;
+    f32 focal_length;
+    volatile u32 reused_count; // Pixels the last frame reused the color of
+    bool is_moving, // The camera moved since the last frame
+         is_reprojecting, // The current frame
+         is_chained; // The last frame was reprojected (so its ages are valid)
+} Reprojection;
+
+// Checkerboard rendering: Frames trace every other pixel, switching between the two halves of a checkerboard from one
+// frame to the next. Once traced, the pixels of the other half get reconstructed: by copying what the last frame traced
+// there, unless the camera moved or that part of the scene changed since. Otherwise from the neighbours that hit the same
+// surface (by material, normal and depth) as the last frame did there, or else from the pair of opposite neighbours that
+// agree (following edges). Traced pixels are kept in the image of the dirty regions and in the G-buffer, for the next
+// frame to copy or to compare with:
+typedef struct {
+    u8 phase; // Pixels with an even x + y + phase get traced by the current frame
+    bool has_history, // The last frame was checkerboarded (so the other half of the G-buffer holds its hits)
+         is_history_valid, // Nothing changed since, so the current frame can copy the other half from the last one
+         is_complete; // The last frame copied all of the other half (so it shows what tracing every pixel would)
+} Checkerboard;
+
+// The workers' ray counts summed up once a frame was rendered, and over the frames since the last report
+// (reported every second of rendering, as with the frame timer):
+typedef struct {
+    RayCounts *worker_counts,
+              frame,
+              accumulated;
+    u64 frame_ticks,
+        accumulated_ticks;
+    f64 megarays_per_second;
+} RayStats;
+
 typedef struct {
     BVH bvh;
     SSB ssb;
     Masks masks;
+    Tiles tiles;
+    Accumulation accumulation;
+    CostMap cost_map;
+    DirtyRegions dirty_regions;
+    Reprojection reprojection;
+    Checkerboard checkerboard;
+    RayStats ray_stats;
     u32 ray_count;
     u8 rays_per_pixel;
+    // The camera ray of each pixel, refilled only once the camera turns or zooms, or the frame gets resized:
     vec3 *ray_directions,
          *ray_directions_rcp;
+    // The G-buffer: The primary hit of each pixel, as of the last frame that traced it in Beauty mode (see DirtyRegions):
+    RayHit *primary_hits;
+    bool ray_directions_changed;
 } RayTracer;
 RayTracer ray_tracer;
 
 #ifdef __CUDACC__
+    // Constant memory is sized for the demo scene (meshes render on the CPU only), the pointers of the copied structs are redirected into it:
+    #define GPU_GEO_COUNT (CUBE_COUNT + SPHERE_COUNT + TETRAHEDRON_COUNT)
+    #define MAX_BVH_NODE_COUNT (2 * GPU_GEO_COUNT - 1)
+
     __constant__ vec3 d_vectors[4];
     __constant__ Masks d_masks[1];
+    __constant__ u64 d_mask_words[3 * GEO_TYPE_COUNT];
     __constant__ BVHNode d_bvh_nodes[MAX_BVH_NODE_COUNT];
     __constant__ GeometryBounds d_ssb_bounds[1];
+    __constant__ Bounds2Di d_ssb_bounds_array[GPU_GEO_COUNT];
 
-    #define copyMasksFromCPUtoGPU(masks) gpuErrchk(cudaMemcpyToSymbol(d_masks, masks, sizeof(Masks), 0, cudaMemcpyHostToDevice))
     #define copyBVHNodesFromCPUtoGPU(bvh_nodes) gpuErrchk(cudaMemcpyToSymbol(d_bvh_nodes, bvh_nodes, sizeof(BVHNode) * MAX_BVH_NODE_COUNT, 0, cudaMemcpyHostToDevice))
-    #define copySSBBoundsFromCPUtoGPU(ssb_bounds) gpuErrchk(cudaMemcpyToSymbol(d_ssb_bounds, ssb_bounds, sizeof(GeometryBounds), 0, cudaMemcpyHostToDevice))
+
+    void copyMasksFromCPUtoGPU(Masks *masks) {
+        Masks device_masks;
+        u64 words[3 * GEO_TYPE_COUNT], *device_words,
+            **host_mask = (u64**)masks,
+            **device_mask = (u64**)&device_masks;
+        gpuErrchk(cudaGetSymbolAddress((void**)&device_words, d_mask_words));
+        for (u8 i = 0; i < 3 * GEO_TYPE_COUNT; i++) {
+            words[i] = *host_mask[i];
+            device_mask[i] = device_words + i;
+        }
+        gpuErrchk(cudaMemcpyToSymbol(d_mask_words, words, sizeof(words), 0, cudaMemcpyHostToDevice));
+        gpuErrchk(cudaMemcpyToSymbol(d_masks, &device_masks, sizeof(Masks), 0, cudaMemcpyHostToDevice));
+    }
+
+    void copySSBBoundsFromCPUtoGPU(GeometryBounds *bounds) {
+        GeometryBounds device_bounds;
+        gpuErrchk(cudaGetSymbolAddress((void**)&device_bounds.cubes, d_ssb_bounds_array));
+        device_bounds.spheres = device_bounds.cubes + CUBE_COUNT;
+        device_bounds.tetrahedra = device_bounds.spheres + SPHERE_COUNT;
+        device_bounds.meshes = 0;
+        gpuErrchk(cudaMemcpyToSymbol(d_ssb_bounds_array, bounds->cubes, sizeof(Bounds2Di) * CUBE_COUNT, 0, cudaMemcpyHostToDevice));
+        gpuErrchk(cudaMemcpyToSymbol(d_ssb_bounds_array, bounds->spheres, sizeof(Bounds2Di) * SPHERE_COUNT, sizeof(Bounds2Di) * CUBE_COUNT, cudaMemcpyHostToDevice));
+        gpuErrchk(cudaMemcpyToSymbol(d_ssb_bounds_array, bounds->tetrahedra, sizeof(Bounds2Di) * TETRAHEDRON_COUNT, sizeof(Bounds2Di) * (CUBE_COUNT + SPHERE_COUNT), cudaMemcpyHostToDevice));
+        gpuErrchk(cudaMemcpyToSymbol(d_ssb_bounds, &device_bounds, sizeof(GeometryBounds), 0, cudaMemcpyHostToDevice));
+    }
 #endif
\ No newline at end of file
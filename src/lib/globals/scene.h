@@ -2,11 +2,12 @@
 
 #include "lib/core/types.h"
 
-#define GEO_TYPE_COUNT 3
+#define GEO_TYPE_COUNT 4
+
+// Geometry counts of the demo scene (scenes are sized at runtime, see Scene):
 #define TETRAHEDRON_COUNT 4
 #define CUBE_COUNT 4
 #define SPHERE_COUNT 4
-#define MAX_GEO_COUNT 4
 
 #define POINT_LIGHT_COUNT 3
 #define PLANE_COUNT 6
@@ -25,9 +26,11 @@
 #define GeoTypeCube 0
 #define GeoTypeSphere 1
 #define GeoTypeTetrahedron 2
+#define GeoTypeMesh 3
 
 typedef struct {
-    u8 id, type, material_id;
+    u16 id;
+    u8 type, material_id;
 } Geometry;
 
 // Primitives:
@@ -65,6 +68,33 @@ typedef struct {
 
 
 
+// Triangle meshes:
+// ===============
+typedef struct {
+    u32 v1, v2, v3;
+} TriangleIndices;
+
+// Children of inner nodes are next to each other (right = left + 1), leaves have a range of triangles instead:
+#define MESH_BVH_LEAF_SIZE 4
+typedef struct {
+    AABB aabb;
+    u32 first, // The left child of an inner node, or the first triangle of a leaf
+        count; // The triangle count of a leaf (zero for inner nodes)
+} MeshBVHNode;
+
+// Vertices are relative to the node's position (the centre of its bounds), so moving a mesh leaves its BVH intact.
+// Triangles are stored in the order of the BVH's leaves:
+typedef struct {
+    Node node;
+    vec3 *vertices;
+    TriangleIndices *triangles;
+    MeshBVHNode *bvh_nodes;
+    u32 vertex_count,
+        triangle_count,
+        bvh_node_count;
+} Mesh;
+
+
 // Materials:
 // =========
 typedef struct {
@@ -126,9 +156,10 @@ typedef struct {
 
 typedef Node* NodePtr;
 typedef struct {
-    NodePtr cubes[CUBE_COUNT];
-    NodePtr spheres[SPHERE_COUNT];
-    NodePtr tetrahedra[TETRAHEDRON_COUNT];
+    NodePtr *cubes,
+            *spheres,
+            *tetrahedra,
+            *meshes;
 } NodePointers;
 
 vec3 tetrahedron_initial_vertex_positions[4] = {
@@ -154,6 +185,33 @@ vec3 cube_initial_vertex_positions[8] = {
 Indices cube_indices[6];
 Indices tetrahedron_indices[4];
 
+// Structure-of-arrays mirror:
+// ==========================
+// Hot intersection data only, kept in sync by the node functions (setNodePosition, rotateNode, setNodeRadius).
+// Arrays are aligned and padded to whole SIMD registers, padding has a zero radius so it never gets hit.
+#define SOA_WIDTH 8
+#define SOA_SIZE(count) ((((count) + SOA_WIDTH - 1) / SOA_WIDTH) * SOA_WIDTH)
+
+typedef struct {
+    f32 *x, *y, *z, *r;
+} NodesSoA;
+
+// A plane per face: A point on it (p) and its normal (n)
+typedef struct {
+    f32 *px, *py, *pz,
+        *nx, *ny, *nz;
+} FacesSoA;
+
+typedef struct {
+    NodesSoA cubes,
+             spheres,
+             tetrahedra;
+    FacesSoA planes,
+             cube_faces,
+             tetrahedron_faces;
+} SceneSoA;
+SceneSoA scene_soa;
+
 // Scene:
 // =====
 typedef struct {
@@ -164,14 +222,37 @@ typedef struct {
     Sphere *spheres;
     Plane *planes;
     Cube *cubes;
+    Mesh *meshes;
     Indices *cube_indices;
     Indices *tetrahedron_indices;
     NodePointers node_ptrs;
+    SceneSoA *soa;
+    u16 cube_count,
+        sphere_count,
+        tetrahedron_count,
+        mesh_count;
 } Scene;
 
 Scene main_scene;
 
+#define getSceneGeometryCount(scene) ((u32)(scene)->cube_count + (scene)->sphere_count + (scene)->tetrahedron_count + (scene)->mesh_count)
+
+// A scene file mapped in by the platform layer before initialization (the demo scene gets built otherwise):
+typedef struct {
+    u8 *data;
+    u64 size;
+} SceneFile;
+SceneFile scene_file;
+
+// OBJ files to import into the demo scene as meshes, set by the platform layer before initialization:
+typedef struct {
+    char **paths;
+    u16 count;
+} MeshFiles;
+MeshFiles mesh_files;
+
 #ifdef __CUDACC__
+    // Constant memory is sized for the demo scene:
     __constant__ PointLight d_point_lights[POINT_LIGHT_COUNT];
     __constant__ Material d_materials[MATERIAL_COUNT];
     __constant__ Sphere d_spheres[SPHERE_COUNT];
@@ -32,4 +32,89 @@ typedef struct {
 } Timer;
 Timer render_timer,
       update_timer,
-      aux_timer;
\ No newline at end of file
+      aux_timer;
+
+// Profiler:
+// ========
+// Named scopes of the main thread's frame, nested in the order they get entered (see profileBegin in perf.h).
+// Each scope keeps the ticks it took in each of the last frames it was entered in, for a rolling min/avg/p99.
+// A frame's scope spans from the start of one update to the start of the next (so presenting is part of it).
+#define PROFILE_HISTORY_LENGTH 128
+#define PROFILE_MAX_DEPTH 8
+#define PROFILE_TEXT_LENGTH 1024
+
+enum ProfileScopeId {
+    ProfileFrame,
+    ProfileInput,
+    ProfileBVHUpdate,
+    ProfileControllerUpdate,
+    ProfileAnimation,
+    ProfileSSB,
+    ProfileRender,
+    ProfileOverlays,
+    ProfilePresent,
+
+    PROFILE_SCOPE_COUNT
+};
+
+static char* PROFILE_SCOPE_NAMES[PROFILE_SCOPE_COUNT] = {
+    "Frame",
+    "Input",
+    "BVH update",
+    "Controller",
+    "Animation",
+    "onMove/SSB",
+    "Render",
+    "Overlays",
+    "Present"
+};
+
+typedef struct {
+    u64 history[PROFILE_HISTORY_LENGTH],
+        ticks_before,
+        frame_ticks; // Summed over all the times the scope was entered within the current frame
+    u32 history_count,
+        history_index;
+    f64 min_microseconds,
+        average_microseconds,
+        p99_microseconds;
+    u8 depth;
+    bool is_entered;
+} ProfileScope;
+
+typedef struct {
+    ProfileScope scopes[PROFILE_SCOPE_COUNT];
+    u8 stack[PROFILE_MAX_DEPTH], stack_size;
+    bool is_enabled;
+    char text[PROFILE_TEXT_LENGTH];
+} Profiler;
+Profiler profiler;
+
+
+// Trace recording:
+// ===============
+// While recording, each thread appends a complete event (a start and a duration) for every profiler scope and job
+// it runs to its own ring, which keeps only the latest events. The rings can then be written out as a Chrome trace.
+#define TRACE_EVENTS_PER_THREAD 65536
+#define TraceJob PROFILE_SCOPE_COUNT // Jobs run by the worker pool are traced too, along with their job ids
+
+typedef struct {
+    u64 start_ticks,
+        duration_ticks;
+    u32 job_id;
+    u8 name_id; // A ProfileScopeId, or TraceJob
+} TraceEvent;
+
+typedef struct {
+    TraceEvent *events;
+    u32 next_index,
+        count;
+} TraceRing;
+
+typedef struct {
+    TraceRing *rings; // A ring per worker (the main thread being worker 0)
+    u32 thread_count;
+    u64 start_ticks;
+    bool is_recording;
+} TraceRecorder;
+TraceRecorder trace_recorder;
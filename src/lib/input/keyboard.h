@@ -2,9 +2,13 @@
 
 #include "lib/core/types.h"
 #include "lib/globals/app.h"
+#include "lib/globals/display.h"
 #include "lib/globals/inputs.h"
+#include "lib/globals/timers.h"
 
 void keyChanged(u8 key, bool pressed) {
+    frame_changes |= SETTINGS_CHANGED;
+
     if      (key == keys.turn_left) turn_left = pressed;
     else if (key == keys.turn_right) turn_right = pressed;
     else if (key == keys.left) move_left = pressed;
@@ -25,10 +29,18 @@ void keyChanged(u8 key, bool pressed) {
     else if (key == keys.set_normal && !pressed) render_mode = Normals;
     else if (key == keys.set_depth && !pressed) render_mode = Depth;
     else if (key == keys.set_uvs && !pressed) render_mode = UVs;
+    else if (key == keys.set_cost && !pressed) render_mode = Cost;
+    else if (key == keys.cycle_cost_metric && !pressed) cost_metric = (enum CostMetric)((cost_metric + 1) % COST_METRIC_COUNT);
 
     else if (key == keys.toggle_HUD && !pressed) show_hud = !show_hud;
     else if (key == keys.toggle_BVH && !pressed) show_BVH = !show_BVH;
     else if (key == keys.toggle_SSB && !pressed) show_SSB = !show_SSB;
+    else if (key == keys.toggle_accumulation && !pressed) accumulate = !accumulate;
+    else if (key == keys.toggle_profiler && !pressed) profiler.is_enabled = !profiler.is_enabled;
+    else if (key == keys.toggle_trace && !pressed) trace_recording_toggled = true;
+    else if (key == keys.toggle_dynamic_resolution && !pressed)
+        dynamic_resolution.target_milliseconds = dynamic_resolution.target_milliseconds ? 0 : DEFAULT_TARGET_FRAME_TIME;
+    else if (key == keys.toggle_checkerboard && !pressed) checkerboard_rendering = !checkerboard_rendering;
 #ifdef __CUDACC__
     else if (key == keys.toggle_GPU && !pressed) use_GPU = !use_GPU;
 #endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "lib/core/types.h"
+#include "lib/globals/app.h"
 #include "lib/globals/inputs.h"
 
 void initMouse() {
@@ -31,7 +32,9 @@ void initMouse() {
     left_mouse_button.down_pos.x = 0;
 }
 
+// Clicks may grab or select the controls drawn over the frame:
 void setMouseButtonDown(MouseButton *mouse_button, i32 x, i32 y) {
+    frame_changes |= OVERLAYS_CHANGED;
     mouse_button->is_pressed = true;
     mouse_button->is_released = false;
 
@@ -40,6 +43,7 @@ void setMouseButtonDown(MouseButton *mouse_button, i32 x, i32 y) {
 }
 
 void setMouseButtonUp(MouseButton *mouse_button, i32 x, i32 y) {
+    frame_changes |= OVERLAYS_CHANGED;
     mouse_button->is_released = true;
     mouse_button->is_pressed = false;
 
@@ -283,6 +283,19 @@ void norm3(vec3* v) {
     iscaleVec3(v, 1.0f / lengthVec3(v));
 }
 
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void reciprocalVec3(vec3* v, vec3* out) {
+    out->x = 1.0f / v->x;
+    out->y = 1.0f / v->y;
+    out->z = 1.0f / v->z;
+}
+
 #ifdef __CUDACC__
 __device__
 __host__
@@ -1,26 +1,149 @@
 #pragma once
 #include "lib/core/types.h"
+#include "virtual_memory.h"
 
 #define Kilobytes(value) ((value)*1024LL)
 #define Megabytes(value) (Kilobytes(value)*1024LL)
 #define Gigabytes(value) (Megabytes(value)*1024LL)
 #define Terabytes(value) (Gigabytes(value)*1024LL)
 #define Alloc(T) (T*)allocate(sizeof(T))
-#define AllocN(T, N) (T*)allocate(sizeof(T) * N)
+#define AllocN(T, N) (T*)allocate(sizeof(T) * (N))
+#define AllocAlignedN(T, N, alignment) (T*)allocateAligned(sizeof(T) * (N), alignment)
+#define AllocFrameN(T, N) (T*)allocateFrom(&frame_memory, sizeof(T) * (N), MEMORY_ALIGNMENT)
+#define AllocHugeN(T, N) (T*)allocateHugePages(sizeof(T) * (N))
+#define AllocPixelsN(T, N) (T*)allocatePixels(sizeof(T) * (N))
 
-#define MEMORY_SIZE Gigabytes(1)
+#define MEMORY_SIZE Gigabytes(8) // Reserved only (pages get committed as they fill up), enough to import meshes of 10M triangles
 #define MEMORY_BASE Terabytes(2)
+#define MEMORY_ALIGNMENT 8 // Of allocations that do not ask for an alignment (a power of 2)
+#define FRAME_MEMORY_SIZE Megabytes(64)
+#define MEMORY_COMMIT_STEP HUGE_PAGE_SIZE
+#define PIXEL_MEMORY_SIZE Gigabytes(8) // Address space only, enough for every per-pixel buffer at the maximum resolution
+#define PIXEL_MEMORY_ALIGNMENT 64 // A cache line (rows of the frame buffer are padded to it)
 
+// A bump allocator over a fixed block, address being where the next allocation starts.
+// Allocations that would not fit return 0 (leaving the arena as it was), and are counted.
+// Blocks that are only reserved get committed in steps as they fill up:
 typedef struct Memory {
     u8* address;
-    u64 occupied;
+    u64 occupied,
+        committed,
+        capacity,
+        overflow_count;
 } Memory;
-static Memory memory;
+static Memory memory,
+              frame_memory, // Scratch for the current frame, reset at the start of each one (see updateAndRender and updateBVH)
+              pixel_memory; // The per-pixel buffers, sized to the frame and reallocated when it gets resized (see resize)
 
-void* allocate(u64 size) {
-    memory.occupied += size;
+// Where an arena is at, for releasing everything allocated after it:
+typedef u64 MemoryMarker;
 
-    void* address = memory.address;
-    memory.address += size;
+// Large buffers that get swept through every frame (like the frame buffer) may be backed by huge pages (set by the platform):
+enum HugePages {
+    HugePagesOff,
+    HugePagesTransparent,
+    HugePagesExplicit
+};
+enum HugePages huge_pages = HugePagesOff;
+
+void initMemory(Memory *arena, void *address, u64 capacity) {
+    arena->address = (u8*)address;
+    arena->occupied = 0;
+    arena->capacity = arena->committed = address ? capacity : 0;
+    arena->overflow_count = 0;
+}
+
+// For blocks reserved with reserveMemory (which must be aligned to the commit step):
+void initReservedMemory(Memory *arena, void *address, u64 capacity) {
+    initMemory(arena, address, capacity);
+    arena->committed = 0;
+}
+
+void* allocateFrom(Memory *arena, u64 size, u64 alignment) {
+    u64 padding = (alignment - ((u64)arena->address & (alignment - 1))) & (alignment - 1);
+    if (size + padding > arena->capacity - arena->occupied) {
+        arena->overflow_count++;
+        return 0;
+    }
+
+    u64 occupied = arena->occupied + padding + size;
+    if (occupied > arena->committed) {
+        u64 committed = (occupied + MEMORY_COMMIT_STEP - 1) / MEMORY_COMMIT_STEP * MEMORY_COMMIT_STEP;
+        if (committed > arena->capacity) committed = arena->capacity;
+        if (!commitMemory(arena->address - arena->occupied + arena->committed, committed - arena->committed)) {
+            arena->overflow_count++;
+            return 0;
+        }
+        arena->committed = committed;
+    }
+
+    arena->occupied += padding + size;
+    void* address = arena->address + padding;
+    arena->address += padding + size;
+    return address;
+}
+
+inline void* allocate(u64 size) {
+    return allocateFrom(&memory, size, MEMORY_ALIGNMENT);
+}
+
+inline void* allocateAligned(u64 size, u64 alignment) {
+    return allocateFrom(&memory, size, alignment);
+}
+
+inline MemoryMarker saveMemory(Memory *arena) {
+    return arena->occupied;
+}
+
+inline void restoreMemory(Memory *arena, MemoryMarker marker) {
+    arena->address -= arena->occupied - marker;
+    arena->occupied = marker;
+}
+
+inline void resetMemory(Memory *arena) {
+    restoreMemory(arena, 0);
+}
+
+// Gives back the committed pages past the occupied ones, of blocks that are only reserved:
+void trimMemory(Memory *arena) {
+    u64 committed = (arena->occupied + MEMORY_COMMIT_STEP - 1) / MEMORY_COMMIT_STEP * MEMORY_COMMIT_STEP;
+    if (committed >= arena->committed) return;
+
+    decommitMemory(arena->address - arena->occupied + committed, arena->committed - committed);
+    arena->committed = committed;
+}
+
+// Buffers smaller than a huge page are allocated as usual.
+// Explicit huge pages come from a mapping of their own, falling back to transparent ones when none are available:
+void* allocateHugePages(u64 size) {
+    if (huge_pages == HugePagesOff || size < HUGE_PAGE_SIZE) return allocate(size);
+
+    size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void *address = huge_pages == HugePagesExplicit ? mapHugePages(size) : 0;
+    if (address) return address;
+
+    address = allocateAligned(size, HUGE_PAGE_SIZE);
+    if (address) adviseHugePages(address, size);
+    return address;
+}
+
+// Buffers that got a mapping of their own are not released along with the arena, so have to be given back:
+void releaseHugePages(void *address, u64 size) {
+    u8 *start = memory.address - memory.occupied;
+    if (!address || ((u8*)address >= start && (u8*)address < start + memory.capacity)) return;
+
+    unmapHugePages(address, (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+}
+
+// Per-pixel buffers come from a block of their own, so that they can all be released at once and reallocated
+// at a different size. With huge pages they start on one and are advised to be backed by them (explicit
+// huge pages are not mapped for them, as they would not be released along with the block):
+void* allocatePixels(u64 size) {
+    if (huge_pages == HugePagesOff || size < HUGE_PAGE_SIZE)
+        return allocateFrom(&pixel_memory, size, PIXEL_MEMORY_ALIGNMENT);
+
+    size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void *address = allocateFrom(&pixel_memory, size, HUGE_PAGE_SIZE);
+    if (address) adviseHugePages(address, size);
     return address;
-}
\ No newline at end of file
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "lib/core/types.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024ULL)
+
+// Address space is reserved without backing, then committed in steps as it gets allocated
+// (and decommitted when a block that gets reallocated shrinks, see trimMemory).
+// Huge pages are either transparent (the kernel is advised to back a range with them when it can),
+// or explicit (a separate mapping from the reserved pool of huge pages, which may be empty):
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+
+    void* reserveMemory(void *base, u64 size) {
+        return VirtualAlloc(base, (SIZE_T)size, MEM_RESERVE, PAGE_NOACCESS);
+    }
+
+    bool commitMemory(void *address, u64 size) {
+        return VirtualAlloc(address, (SIZE_T)size, MEM_COMMIT, PAGE_READWRITE) != 0;
+    }
+
+    void decommitMemory(void *address, u64 size) {
+        VirtualFree(address, (SIZE_T)size, MEM_DECOMMIT);
+    }
+
+    // Large pages need the lock-pages privilege on Windows, so regular pages are used instead:
+    void adviseHugePages(void *address, u64 size) {}
+    void* mapHugePages(u64 size) { return 0; }
+    void unmapHugePages(void *address, u64 size) {}
+#else
+    #include <sys/mman.h>
+
+    void* reserveMemory(void *base, u64 size) {
+        void *address = mmap(base, (size_t)size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+        return address == MAP_FAILED ? 0 : address;
+    }
+
+    bool commitMemory(void *address, u64 size) {
+        return !mprotect(address, (size_t)size, PROT_READ|PROT_WRITE);
+    }
+
+    // Mapping the range anew drops its pages while keeping it reserved:
+    void decommitMemory(void *address, u64 size) {
+        mmap(address, (size_t)size, PROT_NONE, MAP_FIXED|MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    }
+
+    void adviseHugePages(void *address, u64 size) {
+    #ifdef MADV_HUGEPAGE
+        madvise(address, (size_t)size, MADV_HUGEPAGE);
+    #endif
+    }
+
+    void* mapHugePages(u64 size) {
+    #ifdef MAP_HUGETLB
+        void *address = mmap(0, (size_t)size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        return address == MAP_FAILED ? 0 : address;
+    #else
+        return 0;
+    #endif
+    }
+
+    void unmapHugePages(void *address, u64 size) {
+        munmap(address, (size_t)size);
+    }
+#endif
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "lib/core/types.h"
+#include "lib/core/threads.h"
+#include "allocators.h"
+
+#define AllocWorkerN(T, N) (T*)allocateForWorker(sizeof(T) * (N), MEMORY_ALIGNMENT)
+
+#define WORKER_MEMORY_SIZE Megabytes(64)
+#define WORKER_MEMORY_CHUNK_SIZE Kilobytes(64)
+
+// Worker arenas:
+// =============
+// Each worker allocates from a chunk of its own, claiming further chunks from a shared block (carved out of the
+// main memory) with a single atomic add, so workers never wait on each other.
+// All chunks get released at the start of each frame (see updateAndRender), along with the frame's statistics:
+typedef struct {
+    Memory chunk; // The current chunk (allocations larger than a chunk claim several consecutive ones)
+    u64 allocated, // Bytes allocated during the frame
+        allocation_count,
+        chunk_count, // Chunks claimed during the frame
+        peak_chunk_count, // The most chunks claimed in any frame
+        overflow_count; // Allocations that found no chunk left (since startup)
+} WorkerMemory;
+
+typedef struct {
+    u8 *address;
+    WorkerMemory *workers; // A cache line each
+    u32 worker_count,
+        chunk_count;
+    volatile u32 next_chunk;
+} WorkerMemoryPool;
+WorkerMemoryPool worker_memory_pool;
+
+// Chunks may have been claimed since the marker was saved, restoring to it then releases the current chunk entirely
+// (earlier chunks stay claimed until the frame ends):
+typedef struct {
+    u8 *chunk;
+    MemoryMarker marker;
+} WorkerMemoryMarker;
+
+void initWorkerMemory(u32 worker_count) {
+    WorkerMemoryPool *pool = &worker_memory_pool;
+    pool->worker_count = worker_count;
+    pool->workers = AllocAlignedN(WorkerMemory, worker_count, 64);
+    pool->address = (u8*)allocateAligned(WORKER_MEMORY_SIZE, WORKER_MEMORY_CHUNK_SIZE);
+    pool->chunk_count = pool->address ? (u32)(WORKER_MEMORY_SIZE / WORKER_MEMORY_CHUNK_SIZE) : 0;
+    pool->next_chunk = 0;
+    for (u32 i = 0; i < worker_count; i++) {
+        initMemory(&pool->workers[i].chunk, 0, 0);
+        pool->workers[i].peak_chunk_count = pool->workers[i].overflow_count = 0;
+    }
+}
+
+// Only while no jobs are running:
+void resetWorkerMemory() {
+    WorkerMemoryPool *pool = &worker_memory_pool;
+    WorkerMemory *worker = pool->workers;
+    for (u32 i = 0; i < pool->worker_count; i++, worker++) {
+        initMemory(&worker->chunk, 0, 0);
+        worker->allocated = worker->allocation_count = worker->chunk_count = 0;
+    }
+    pool->next_chunk = 0;
+}
+
+bool claimWorkerMemoryChunks(WorkerMemory *worker, u64 size) {
+    WorkerMemoryPool *pool = &worker_memory_pool;
+    u32 count = (u32)((size + WORKER_MEMORY_CHUNK_SIZE - 1) / WORKER_MEMORY_CHUNK_SIZE);
+    u32 first = atomicAdd(&pool->next_chunk, count) - count;
+    if (first + count > pool->chunk_count) return false;
+
+    initMemory(&worker->chunk, pool->address + (u64)first * WORKER_MEMORY_CHUNK_SIZE, (u64)count * WORKER_MEMORY_CHUNK_SIZE);
+    worker->chunk_count += count;
+    if (worker->peak_chunk_count < worker->chunk_count) worker->peak_chunk_count = worker->chunk_count;
+    return true;
+}
+
+// Allocates from the calling worker's arena, returning 0 once the shared block runs out:
+void* allocateForWorker(u64 size, u64 alignment) {
+    WorkerMemory *worker = worker_memory_pool.workers + current_worker_id;
+    void *address = allocateFrom(&worker->chunk, size, alignment);
+    if (!address) {
+        // The chunk is aligned to the chunk size, so the allocation fits a fresh one as long as it has room for its size:
+        if (!claimWorkerMemoryChunks(worker, size)) {
+            worker->overflow_count++;
+            return 0;
+        }
+        address = allocateFrom(&worker->chunk, size, alignment);
+    }
+
+    worker->allocated += size;
+    worker->allocation_count++;
+    return address;
+}
+
+inline WorkerMemoryMarker saveWorkerMemory() {
+    WorkerMemoryMarker marker;
+    Memory *chunk = &worker_memory_pool.workers[current_worker_id].chunk;
+    marker.chunk = chunk->address - chunk->occupied;
+    marker.marker = chunk->occupied;
+    return marker;
+}
+
+inline void restoreWorkerMemory(WorkerMemoryMarker marker) {
+    Memory *chunk = &worker_memory_pool.workers[current_worker_id].chunk;
+    restoreMemory(chunk, chunk->address - chunk->occupied == marker.chunk ? marker.marker : 0);
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lib/core/types.h"
+#include "lib/math/math3D.h"
+#include "lib/globals/scene.h"
+#include "lib/memory/allocators.h"
+#include "lib/render/BVH.h"
+
+// OBJ import:
+// ==========
+// Files are streamed through a fixed buffer twice: Once to count the vertices and triangles, then to read them.
+// Only vertex positions and faces are read, faces are split into triangle fans.
+#define OBJ_READ_BUFFER_SIZE Kilobytes(64)
+
+static char obj_read_buffer[OBJ_READ_BUFFER_SIZE + 1];
+
+typedef struct {
+    FILE *file;
+    char *buffer;
+    u32 start, end;
+    bool is_at_end;
+} OBJReader;
+
+// Lines longer than the buffer get split:
+bool readOBJLine(OBJReader *reader, char **line) {
+    char *buffer = reader->buffer, *new_line;
+    u32 length;
+
+    while (true) {
+        length = reader->end - reader->start;
+        new_line = (char*)memchr(buffer + reader->start, '\n', length);
+        if (new_line || reader->is_at_end || length == OBJ_READ_BUFFER_SIZE) {
+            if (!length) return false;
+
+            *line = buffer + reader->start;
+            if (new_line) {
+                *new_line = 0;
+                reader->start = (u32)(new_line - buffer) + 1;
+            } else {
+                buffer[reader->end] = 0;
+                reader->start = reader->end;
+            }
+            return true;
+        }
+
+        memmove(buffer, buffer + reader->start, length);
+        reader->start = 0;
+        reader->end = length;
+        length = (u32)fread(buffer + length, 1, OBJ_READ_BUFFER_SIZE - length, reader->file);
+        reader->end += length;
+        reader->is_at_end = !length;
+    }
+}
+
+// Reads the face's vertex index (the position index of a v/vt/vn triplet), advancing past it:
+bool readOBJFaceIndex(char **text, u32 vertex_count, u32 *index) {
+    char *end;
+    long value = strtol(*text, &end, 10);
+    if (end == *text) return false;
+
+    while (*end && *end != ' ' && *end != '\t' && *end != '\r') end++; // Skip texture and normal indices
+    *text = end;
+
+    // Indices are 1-based, negative ones are relative to the last vertex read so far:
+    if (value < 0) value += (long)vertex_count;
+    else value--;
+    if (value < 0) return false;
+
+    *index = (u32)value;
+    return true;
+}
+
+// Counts the mesh's vertices and triangles, also reading them when given arrays for them.
+// Returns false when a face is malformed (or references a vertex that does not exist):
+bool readOBJ(FILE *file, Mesh *mesh, vec3 *vertices, TriangleIndices *triangles) {
+    OBJReader reader;
+    reader.file = file;
+    reader.buffer = obj_read_buffer;
+    reader.start = reader.end = 0;
+    reader.is_at_end = false;
+
+    u32 total_vertex_count = mesh->vertex_count, first, previous, current;
+    u32 vertex_count = 0, triangle_count = 0, face_vertex_count;
+    char *line, *end;
+    bool is_valid = true;
+
+    while (is_valid && readOBJLine(&reader, &line)) {
+        while (*line == ' ' || *line == '\t') line++;
+        if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+            if (vertices) {
+                line += 2;
+                vertices->x = strtof(line, &end); line = end;
+                vertices->y = strtof(line, &end); line = end;
+                vertices->z = strtof(line, &end);
+                vertices++;
+            }
+            vertex_count++;
+        } else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+            line += 2;
+            face_vertex_count = 0;
+            while (readOBJFaceIndex(&line, vertex_count, &current)) {
+                if (vertices && current >= total_vertex_count) {
+                    is_valid = false;
+                    break;
+                }
+
+                if (face_vertex_count == 0) first = current;
+                else if (face_vertex_count >= 2) {
+                    if (triangles) {
+                        triangles->v1 = first;
+                        triangles->v2 = previous;
+                        triangles->v3 = current;
+                        triangles++;
+                    }
+                    triangle_count++;
+                }
+                previous = current;
+                face_vertex_count++;
+            }
+        }
+    }
+
+    mesh->vertex_count = vertex_count;
+    mesh->triangle_count = triangle_count;
+    return is_valid && !ferror(file);
+}
+
+// Imports the OBJ file's geometry into the mesh and builds its BVH, the node's geometry is left to the caller.
+// The mesh's node is placed at the centre of its bounds, around which its vertices are then stored.
+// Nothing stays allocated for files that fail to import (or do not fit in memory):
+bool loadMeshFromOBJ(Mesh *mesh, char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+
+    MemoryMarker marker = saveMemory(&memory);
+    mesh->vertex_count = mesh->triangle_count = 0;
+    mesh->vertices = 0;
+    mesh->triangles = 0;
+    bool is_valid = readOBJ(file, mesh, 0, 0) && mesh->triangle_count;
+    u64 vertices_size = sizeof(vec3) * mesh->vertex_count;
+    u64 triangles_size = sizeof(TriangleIndices) * mesh->triangle_count;
+    if (is_valid) {
+        mesh->vertices = AllocHugeN(vec3, mesh->vertex_count);
+        mesh->triangles = AllocHugeN(TriangleIndices, mesh->triangle_count);
+        rewind(file);
+        is_valid = mesh->vertices && mesh->triangles && readOBJ(file, mesh, mesh->vertices, mesh->triangles);
+    }
+    fclose(file);
+    if (!is_valid) {
+        releaseHugePages(mesh->vertices, vertices_size);
+        releaseHugePages(mesh->triangles, triangles_size);
+        restoreMemory(&memory, marker);
+        return false;
+    }
+
+    AABB aabb;
+    resetAABB(&aabb);
+    vec3 *vertex = mesh->vertices;
+    for (u32 i = 0; i < mesh->vertex_count; i++, vertex++) growAABBbyPoint(&aabb, vertex);
+
+    vec3 *center = &mesh->node.position;
+    addVec3(&aabb.min, &aabb.max, center);
+    iscaleVec3(center, 0.5f);
+
+    f32 radius_squared = 0;
+    vertex = mesh->vertices;
+    for (u32 i = 0; i < mesh->vertex_count; i++, vertex++) {
+        isubVec3(vertex, center);
+        radius_squared = max(radius_squared, squaredLengthVec3(vertex));
+    }
+    mesh->node.radius = sqrtf(radius_squared);
+
+    if (buildMeshBVH(mesh)) return true;
+
+    releaseHugePages(mesh->vertices, vertices_size);
+    releaseHugePages(mesh->triangles, triangles_size);
+    restoreMemory(&memory, marker);
+    return false;
+}
@@ -4,8 +4,61 @@
 #include "lib/math/math3D.h"
 #include "lib/globals/scene.h"
 
+inline void updateNodeSoA(Node *node) {
+    u8 face_count = 0;
+    NodesSoA *nodes;
+    FacesSoA *faces;
+    vec3 *vertices, *v;
+    mat3 *tangent_to_world;
+    Indices *indices;
+
+    switch (node->geo.type) {
+        case GeoTypeCube:
+            face_count = 6;
+            nodes = &scene_soa.cubes;
+            faces = &scene_soa.cube_faces;
+            vertices = ((Cube*)node)->vertices;
+            tangent_to_world = ((Cube*)node)->tangent_to_world;
+            indices = cube_indices;
+            break;
+
+        case GeoTypeTetrahedron:
+            face_count = 4;
+            nodes = &scene_soa.tetrahedra;
+            faces = &scene_soa.tetrahedron_faces;
+            vertices = ((Tetrahedron*)node)->vertices;
+            tangent_to_world = ((Tetrahedron*)node)->tangent_to_world;
+            indices = tetrahedron_indices;
+            break;
+
+        case GeoTypeMesh: // Meshes are not mirrored
+            return;
+
+        default:
+            nodes = &scene_soa.spheres;
+            break;
+    }
+
+    u16 id = node->geo.id;
+    nodes->x[id] = node->position.x;
+    nodes->y[id] = node->position.y;
+    nodes->z[id] = node->position.z;
+    nodes->r[id] = node->radius;
+
+    u32 face_id = (u32)id * face_count;
+    for (u8 i = 0; i < face_count; i++, face_id++) {
+        v = vertices + indices[i].v1;
+        faces->px[face_id] = v->x;
+        faces->py[face_id] = v->y;
+        faces->pz[face_id] = v->z;
+        faces->nx[face_id] = tangent_to_world[i].Z.x;
+        faces->ny[face_id] = tangent_to_world[i].Z.y;
+        faces->nz[face_id] = tangent_to_world[i].Z.z;
+    }
+}
+
 inline void setNodePosition(Node *node, vec3 *position) {
-    u8 vertex_count;
+    u8 vertex_count = 0;
     vec3 *vertex_positions;
 
     switch (node->geo.type) {
@@ -24,11 +77,12 @@ inline void setNodePosition(Node *node, vec3 *position) {
     subVec3(position, &node->position, &movement);
     for (u8 i = 0; i < vertex_count; i++) iaddVec3(vertex_positions + i, &movement);
     node->position = *position;
+    updateNodeSoA(node);
 }
 
 inline void setNodeTangentMatrices(Node *node) {
     mat3 transform;
-    u8 face_count;
+    u8 face_count = 0;
     mat3 *tangent_to_world, *world_to_tangent;
 
     switch (node->geo.type) {
@@ -62,7 +116,7 @@ inline void setNodeTangentMatrices(Node *node) {
 }
 
 inline void rotateNode(Node *node, mat3 *rotation) {
-    u8 vertex_count, face_count;
+    u8 vertex_count = 0, face_count = 0;
     vec3 *vertex_positions;
     mat3 *tangent_to_world;
 
@@ -93,10 +147,11 @@ inline void rotateNode(Node *node, mat3 *rotation) {
     for (u8 i = 0; i < face_count; i++) imulMat3(tangent_to_world + i, rotation);
 
     setNodeTangentMatrices(node);
+    updateNodeSoA(node);
 }
 
 inline void setNodeRadius(Node *node, f32 radius) {
-    u8 vertex_count;
+    u8 vertex_count = 0;
     vec3 *vertex_positions;
 
     switch (node->geo.type) {
@@ -121,12 +176,13 @@ inline void setNodeRadius(Node *node, f32 radius) {
     }
     node->radius = radius;
     setNodeTangentMatrices(node);
+    updateNodeSoA(node);
 }
 
 void initNode(Node *node, f32 radius) {
     node->radius = radius;
 
-    u8 vertex_count, face_count;
+    u8 vertex_count = 0, face_count = 0;
     vec3 *vertex_positions, *initial_vertex_positions;
     mat3 *tangent_to_world;
     Indices *indices;
@@ -1,11 +1,13 @@
 #pragma once
 
 #include "lib/core/types.h"
+#include "lib/globals/app.h"
 #include "lib/globals/scene.h"
 #include "lib/memory/allocators.h"
 #include "lib/math/math3D.h"
 
 #include "node.h"
+#include "mesh.h"
 #include "camera.h"
 
 void initGeometryMetadata() {
@@ -116,16 +118,75 @@ void initGeometryMetadata() {
 
 }
 
+#ifdef __CUDACC__
+void copySceneFromCPUtoGPU(Scene *scene) {
+    gpuErrchk(cudaMemcpyToSymbol(d_cube_indices, scene->cube_indices, sizeof(Indices) * 6, 0, cudaMemcpyHostToDevice));
+    gpuErrchk(cudaMemcpyToSymbol(d_tetrahedron_indices, scene->tetrahedron_indices, sizeof(Indices) * 4, 0, cudaMemcpyHostToDevice));
+    gpuErrchk(cudaMemcpyToSymbol(d_ambient_light, scene->ambient_light, sizeof(AmbientLight), 0, cudaMemcpyHostToDevice));
+    gpuErrchk(cudaMemcpyToSymbol(d_point_lights, scene->point_lights, sizeof(PointLight) * POINT_LIGHT_COUNT, 0, cudaMemcpyHostToDevice));
+    gpuErrchk(cudaMemcpyToSymbol(d_tetrahedra, scene->tetrahedra, sizeof(Tetrahedron) * TETRAHEDRON_COUNT, 0, cudaMemcpyHostToDevice));
+    gpuErrchk(cudaMemcpyToSymbol(d_materials, scene->materials, sizeof(Material) * MATERIAL_COUNT, 0, cudaMemcpyHostToDevice));
+    gpuErrchk(cudaMemcpyToSymbol(d_spheres, scene->spheres, sizeof(Sphere) * SPHERE_COUNT, 0, cudaMemcpyHostToDevice));
+    gpuErrchk(cudaMemcpyToSymbol(d_planes, scene->planes, sizeof(Plane) * PLANE_COUNT, 0, cudaMemcpyHostToDevice));
+    gpuErrchk(cudaMemcpyToSymbol(d_cubes, scene->cubes, sizeof(Cube) * CUBE_COUNT, 0, cudaMemcpyHostToDevice));
+}
+#endif
+
+void initNodesSoA(NodesSoA *nodes, u32 count) {
+    count = SOA_SIZE(count);
+    nodes->x = AllocAlignedN(f32, count, 32);
+    nodes->y = AllocAlignedN(f32, count, 32);
+    nodes->z = AllocAlignedN(f32, count, 32);
+    nodes->r = AllocAlignedN(f32, count, 32);
+    for (u32 i = 0; i < count; i++) nodes->x[i] = nodes->y[i] = nodes->z[i] = nodes->r[i] = 0;
+}
+
+void initFacesSoA(FacesSoA *faces, u32 count) {
+    count = SOA_SIZE(count);
+    faces->px = AllocAlignedN(f32, count, 32);
+    faces->py = AllocAlignedN(f32, count, 32);
+    faces->pz = AllocAlignedN(f32, count, 32);
+    faces->nx = AllocAlignedN(f32, count, 32);
+    faces->ny = AllocAlignedN(f32, count, 32);
+    faces->nz = AllocAlignedN(f32, count, 32);
+    for (u32 i = 0; i < count; i++)
+        faces->px[i] = faces->py[i] = faces->pz[i] =
+        faces->nx[i] = faces->ny[i] = faces->nz[i] = 0;
+}
+
+// Allocates the geometry of a scene of the given size (the arrays of meshes are allocated when they are loaded):
+void initSceneGeometry(Scene *scene, u16 cube_count, u16 sphere_count, u16 tetrahedron_count, u16 mesh_count) {
+    scene->cube_count = cube_count;
+    scene->sphere_count = sphere_count;
+    scene->tetrahedron_count = tetrahedron_count;
+    scene->mesh_count = mesh_count;
+
+    scene->cubes = AllocN(Cube, cube_count);
+    scene->spheres = AllocN(Sphere, sphere_count);
+    scene->tetrahedra = AllocN(Tetrahedron, tetrahedron_count);
+    scene->meshes = AllocN(Mesh, mesh_count);
+    scene->node_ptrs.cubes = AllocN(NodePtr, cube_count);
+    scene->node_ptrs.spheres = AllocN(NodePtr, sphere_count);
+    scene->node_ptrs.tetrahedra = AllocN(NodePtr, tetrahedron_count);
+    scene->node_ptrs.meshes = AllocN(NodePtr, mesh_count);
+
+    scene->soa = &scene_soa;
+    initNodesSoA(&scene_soa.cubes, cube_count);
+    initNodesSoA(&scene_soa.spheres, sphere_count);
+    initNodesSoA(&scene_soa.tetrahedra, tetrahedron_count);
+    initFacesSoA(&scene_soa.planes, PLANE_COUNT);
+    initFacesSoA(&scene_soa.cube_faces, (u32)cube_count * 6);
+    initFacesSoA(&scene_soa.tetrahedron_faces, (u32)tetrahedron_count * 4);
+}
+
 void initScene(Scene *scene) {
     initGeometryMetadata();
+    initSceneGeometry(scene, CUBE_COUNT, SPHERE_COUNT, TETRAHEDRON_COUNT, mesh_files.count);
     scene->cube_indices = cube_indices;
     scene->tetrahedron_indices = tetrahedron_indices;
-    scene->tetrahedra = AllocN(Tetrahedron, TETRAHEDRON_COUNT);
     scene->point_lights = AllocN(PointLight, POINT_LIGHT_COUNT);
     scene->materials = AllocN(Material, MATERIAL_COUNT);
-    scene->spheres = AllocN(Sphere, SPHERE_COUNT);
     scene->planes = AllocN(Plane, PLANE_COUNT);
-    scene->cubes = AllocN(Cube, CUBE_COUNT);
     scene->ambient_light = Alloc(AmbientLight);
     scene->ambient_light->color.x = 0.008f;
     scene->ambient_light->color.y = 0.008f;
@@ -277,7 +338,7 @@ void initScene(Scene *scene) {
     u8 material_id = 1;
     for (u8 i = 0; i < SPHERE_COUNT; i++, radius++, material_id++, sphere++) {
         sphere->node.geo.id = i;
-        sphere->node.geo.type = GeoTypeTetrahedron;
+        sphere->node.geo.type = GeoTypeSphere;
         sphere->node.radius = radius;
         sphere->node.position.y = radius;
         sphere->node.geo.material_id = material_id;
@@ -311,6 +372,26 @@ void initScene(Scene *scene) {
     pos->x = 4;
     pos->z = -3;
 
+    for (u8 i = 0; i < SPHERE_COUNT; i++) updateNodeSoA(scene->node_ptrs.spheres[i]);
+
+    // Meshes that fail to import are left out:
+    Mesh *mesh = scene->meshes;
+    scene->mesh_count = 0;
+    for (u16 i = 0; i < mesh_files.count; i++) {
+        if (!loadMeshFromOBJ(mesh, mesh_files.paths[i])) {
+            printDebugString("Could not import mesh: ");
+            printDebugString(mesh_files.paths[i]);
+            printDebugString("\n");
+            continue;
+        }
+
+        node = scene->node_ptrs.meshes[scene->mesh_count] = &mesh->node;
+        node->geo.id = scene->mesh_count++;
+        node->geo.type = GeoTypeMesh;
+        node->geo.material_id = blinn_material_id;
+        mesh++;
+    }
+
     Plane* plane;
     for (u8 i = 0; i < PLANE_COUNT; i++) {
         plane = &scene->planes[i];
@@ -341,6 +422,17 @@ void initScene(Scene *scene) {
     left_plane->normal.x   = 1;
     right_plane->normal.x  = -1;
 
+    FacesSoA *planes = &scene->soa->planes;
+    plane = scene->planes;
+    for (u8 i = 0; i < PLANE_COUNT; i++, plane++) {
+        planes->px[i] = plane->node.position.x;
+        planes->py[i] = plane->node.position.y;
+        planes->pz[i] = plane->node.position.z;
+        planes->nx[i] = plane->normal.x;
+        planes->ny[i] = plane->normal.y;
+        planes->nz[i] = plane->normal.z;
+    }
+
     PointLight *key_light = scene->point_lights;
     PointLight *fill_light = scene->point_lights + 1;
     PointLight *rim_light = scene->point_lights + 2;
@@ -370,14 +462,6 @@ void initScene(Scene *scene) {
     fill_light->intensity = 1.1f * 3;
 
 #ifdef __CUDACC__
-    gpuErrchk(cudaMemcpyToSymbol(d_cube_indices, scene->cube_indices, sizeof(Indices) * 6, 0, cudaMemcpyHostToDevice));
-    gpuErrchk(cudaMemcpyToSymbol(d_tetrahedron_indices, scene->tetrahedron_indices, sizeof(Indices) * 4, 0, cudaMemcpyHostToDevice));
-    gpuErrchk(cudaMemcpyToSymbol(d_ambient_light, scene->ambient_light, sizeof(AmbientLight), 0, cudaMemcpyHostToDevice));
-    gpuErrchk(cudaMemcpyToSymbol(d_point_lights, scene->point_lights, sizeof(PointLight) * POINT_LIGHT_COUNT, 0, cudaMemcpyHostToDevice));
-    gpuErrchk(cudaMemcpyToSymbol(d_tetrahedra, scene->tetrahedra, sizeof(Tetrahedron) * TETRAHEDRON_COUNT, 0, cudaMemcpyHostToDevice));
-    gpuErrchk(cudaMemcpyToSymbol(d_materials, scene->materials, sizeof(Material) * MATERIAL_COUNT, 0, cudaMemcpyHostToDevice));
-    gpuErrchk(cudaMemcpyToSymbol(d_spheres, scene->spheres, sizeof(Sphere) * SPHERE_COUNT, 0, cudaMemcpyHostToDevice));
-    gpuErrchk(cudaMemcpyToSymbol(d_planes, scene->planes, sizeof(Plane) * PLANE_COUNT, 0, cudaMemcpyHostToDevice));
-    gpuErrchk(cudaMemcpyToSymbol(d_cubes, scene->cubes, sizeof(Cube) * CUBE_COUNT, 0, cudaMemcpyHostToDevice));
+    copySceneFromCPUtoGPU(scene);
 #endif
 }
\ No newline at end of file
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <string.h>
+
+#include "lib/core/types.h"
+#include "lib/globals/app.h"
+#include "lib/globals/scene.h"
+#include "lib/globals/raytracing.h"
+#include "lib/memory/allocators.h"
+#include "lib/render/BVH.h"
+
+#include "scene.h"
+
+// Scene files:
+// ===========
+// A header followed by the scene's arrays, laid out exactly as they are in memory (little-endian).
+// Loading a scene maps the file and points the scene's arrays into it, nothing gets parsed or copied.
+// The mapping has to be copy-on-write, as nodes get moved in place.
+// The struct layouts are part of the format: Changing any of them requires bumping the version.
+// Meshes are the exception to storing things as they are: Their array pointers are stored as offsets into the mesh data.
+#define SCENE_FILE_MAGIC 0x43535452 // "RTSC"
+#define SCENE_FILE_VERSION 4
+#define SCENE_FILE_ALIGNMENT 64
+
+enum SceneFileSectionType {
+    SceneFileAmbientLight,
+    SceneFilePointLights,
+    SceneFileMaterials,
+    SceneFilePlanes,
+    SceneFileCubes,
+    SceneFileSpheres,
+    SceneFileTetrahedra,
+    SceneFileSoA,
+    SceneFileBVHNodes,
+    SceneFileBVHParentIds,
+    SceneFileBVHLeafIds,
+    SceneFileMeshes,
+    SceneFileMeshData,
+
+    SCENE_FILE_SECTION_COUNT
+};
+
+typedef struct {
+    u64 offset, size;
+} SceneFileSection;
+
+typedef struct {
+    u32 magic, version;
+    u16 cube_count,
+        sphere_count,
+        tetrahedron_count,
+        point_light_count,
+        material_count,
+        plane_count,
+        mesh_count;
+    u32 bvh_node_count; // Zero when no BVH is stored
+    u64 mesh_data_size;
+    f32 bvh_area_sum,
+        bvh_built_cost;
+    SceneFileSection sections[SCENE_FILE_SECTION_COUNT];
+} SceneFileHeader;
+
+#define alignSceneFileOffset(offset) (((offset) + SCENE_FILE_ALIGNMENT - 1) & ~(u64)(SCENE_FILE_ALIGNMENT - 1))
+#define getSceneFileSection(T, file, header, section) ((T*)((file) + (header)->sections[section].offset))
+
+// The SceneSoA struct is a sequence of array pointers, the arrays are stored one after the other in that order:
+#define SCENE_SOA_ARRAY_COUNT (sizeof(SceneSoA) / sizeof(f32*))
+
+void getSceneSoAArraySizes(SceneFileHeader *header, u32 *sizes) {
+    u32 node_counts[3] = {header->cube_count, header->sphere_count, header->tetrahedron_count};
+    u32 face_counts[3] = {header->plane_count, (u32)header->cube_count * 6, (u32)header->tetrahedron_count * 4};
+
+    for (u8 i = 0; i < 3; i++) for (u8 j = 0; j < 4; j++) *sizes++ = SOA_SIZE(node_counts[i]);
+    for (u8 i = 0; i < 3; i++) for (u8 j = 0; j < 6; j++) *sizes++ = SOA_SIZE(face_counts[i]);
+}
+
+void getSceneFileSectionSizes(SceneFileHeader *header, u64 *sizes) {
+    u32 primitive_count = header->bvh_node_count ? (header->bvh_node_count + 1) / 2 : 0;
+    u32 soa_sizes[SCENE_SOA_ARRAY_COUNT];
+    getSceneSoAArraySizes(header, soa_sizes);
+
+    sizes[SceneFileAmbientLight] = sizeof(AmbientLight);
+    sizes[SceneFilePointLights]  = sizeof(PointLight)  * (u64)header->point_light_count;
+    sizes[SceneFileMaterials]    = sizeof(Material)    * (u64)header->material_count;
+    sizes[SceneFilePlanes]       = sizeof(Plane)       * (u64)header->plane_count;
+    sizes[SceneFileCubes]        = sizeof(Cube)        * (u64)header->cube_count;
+    sizes[SceneFileSpheres]      = sizeof(Sphere)      * (u64)header->sphere_count;
+    sizes[SceneFileTetrahedra]   = sizeof(Tetrahedron) * (u64)header->tetrahedron_count;
+    sizes[SceneFileSoA] = 0;
+    for (u8 i = 0; i < SCENE_SOA_ARRAY_COUNT; i++) sizes[SceneFileSoA] += sizeof(f32) * (u64)soa_sizes[i];
+    sizes[SceneFileBVHNodes]     = sizeof(BVHNode) * (u64)header->bvh_node_count;
+    sizes[SceneFileBVHParentIds] = sizeof(u32)     * (u64)header->bvh_node_count;
+    sizes[SceneFileBVHLeafIds]   = sizeof(u32)     * (u64)primitive_count;
+    sizes[SceneFileMeshes]       = sizeof(Mesh)    * (u64)header->mesh_count;
+    sizes[SceneFileMeshData]     = header->mesh_data_size;
+}
+
+// Each of a mesh's arrays starts aligned within the mesh data:
+#define MESH_ARRAY_COUNT 3
+
+void getMeshArraySizes(Mesh *mesh, u64 *sizes) {
+    sizes[0] = sizeof(vec3)            * (u64)mesh->vertex_count;
+    sizes[1] = sizeof(TriangleIndices) * (u64)mesh->triangle_count;
+    sizes[2] = sizeof(MeshBVHNode)     * (u64)mesh->bvh_node_count;
+}
+
+u64 getMeshDataSize(Scene *scene) {
+    u64 size = 0, sizes[MESH_ARRAY_COUNT];
+    for (u16 i = 0; i < scene->mesh_count; i++) {
+        getMeshArraySizes(scene->meshes + i, sizes);
+        for (u8 j = 0; j < MESH_ARRAY_COUNT; j++) size += alignSceneFileOffset(sizes[j]);
+    }
+    return size;
+}
+
+// Writes the scene (and its BVH, when given one that is built) into the file buffer, returning the file size.
+// When no buffer is given the file is only measured:
+u64 writeSceneFile(Scene *scene, BVH *bvh, u8 *file) {
+    SceneFileHeader header;
+    memset(&header, 0, sizeof(SceneFileHeader));
+    header.magic = SCENE_FILE_MAGIC;
+    header.version = SCENE_FILE_VERSION;
+    header.cube_count = scene->cube_count;
+    header.sphere_count = scene->sphere_count;
+    header.tetrahedron_count = scene->tetrahedron_count;
+    header.point_light_count = POINT_LIGHT_COUNT;
+    header.material_count = MATERIAL_COUNT;
+    header.plane_count = PLANE_COUNT;
+    header.mesh_count = scene->mesh_count;
+    header.mesh_data_size = getMeshDataSize(scene);
+    if (bvh && bvh->node_count) {
+        header.bvh_node_count = bvh->node_count;
+        header.bvh_area_sum = bvh->area_sum;
+        header.bvh_built_cost = bvh->built_cost;
+    }
+
+    u64 sizes[SCENE_FILE_SECTION_COUNT];
+    getSceneFileSectionSizes(&header, sizes);
+
+    u64 offset = alignSceneFileOffset(sizeof(SceneFileHeader));
+    for (u8 i = 0; i < SCENE_FILE_SECTION_COUNT; i++) {
+        header.sections[i].offset = offset;
+        header.sections[i].size = sizes[i];
+        offset = alignSceneFileOffset(offset + sizes[i]);
+    }
+    if (!file) return offset;
+
+    void *arrays[SCENE_FILE_SECTION_COUNT];
+    arrays[SceneFileAmbientLight] = scene->ambient_light;
+    arrays[SceneFilePointLights]  = scene->point_lights;
+    arrays[SceneFileMaterials]    = scene->materials;
+    arrays[SceneFilePlanes]       = scene->planes;
+    arrays[SceneFileCubes]        = scene->cubes;
+    arrays[SceneFileSpheres]      = scene->spheres;
+    arrays[SceneFileTetrahedra]   = scene->tetrahedra;
+    arrays[SceneFileSoA]          = 0;
+    arrays[SceneFileBVHNodes]     = header.bvh_node_count ? bvh->nodes : 0;
+    arrays[SceneFileBVHParentIds] = header.bvh_node_count ? bvh->parent_ids : 0;
+    arrays[SceneFileBVHLeafIds]   = header.bvh_node_count ? bvh->leaf_ids : 0;
+    arrays[SceneFileMeshes]       = 0;
+    arrays[SceneFileMeshData]     = 0;
+
+    memset(file, 0, offset);
+    memcpy(file, &header, sizeof(SceneFileHeader));
+    for (u8 i = 0; i < SCENE_FILE_SECTION_COUNT; i++)
+        if (arrays[i]) memcpy(file + header.sections[i].offset, arrays[i], sizes[i]);
+
+    u32 soa_sizes[SCENE_SOA_ARRAY_COUNT];
+    getSceneSoAArraySizes(&header, soa_sizes);
+    f32 **soa_array = (f32**)scene->soa;
+    f32 *soa_data = getSceneFileSection(f32, file, &header, SceneFileSoA);
+    for (u8 i = 0; i < SCENE_SOA_ARRAY_COUNT; i++) {
+        memcpy(soa_data, soa_array[i], sizeof(f32) * soa_sizes[i]);
+        soa_data += soa_sizes[i];
+    }
+
+    // Mesh arrays are written one after the other, with the meshes' pointers swapped for their offsets:
+    Mesh *mesh = getSceneFileSection(Mesh, file, &header, SceneFileMeshes);
+    u8 *mesh_data = getSceneFileSection(u8, file, &header, SceneFileMeshData);
+    u64 mesh_data_offset = 0, mesh_array_sizes[MESH_ARRAY_COUNT];
+    void **mesh_arrays[MESH_ARRAY_COUNT];
+    for (u16 i = 0; i < scene->mesh_count; i++, mesh++) {
+        *mesh = scene->meshes[i];
+        mesh_arrays[0] = (void**)&mesh->vertices;
+        mesh_arrays[1] = (void**)&mesh->triangles;
+        mesh_arrays[2] = (void**)&mesh->bvh_nodes;
+        getMeshArraySizes(mesh, mesh_array_sizes);
+        for (u8 j = 0; j < MESH_ARRAY_COUNT; j++) {
+            memcpy(mesh_data + mesh_data_offset, *mesh_arrays[j], mesh_array_sizes[j]);
+            *mesh_arrays[j] = (void*)mesh_data_offset;
+            mesh_data_offset += alignSceneFileOffset(mesh_array_sizes[j]);
+        }
+    }
+
+    return offset;
+}
+
+// Validation:
+// ==========
+// Besides the sizes and offsets of the arrays, the indices stored in them get checked before any of them is followed.
+// Nodes have to be where their geometry says they are, with a material that exists:
+bool areSceneFileNodesValid(u8 *file, SceneFileHeader *header, u8 section, u64 node_size, u16 node_count, u8 geo_type) {
+    u8 *nodes = getSceneFileSection(u8, file, header, section);
+    Node *node;
+    for (u16 i = 0; i < node_count; i++, nodes += node_size) {
+        node = (Node*)nodes;
+        if (node->geo.type != geo_type || node->geo.id != i || node->geo.material_id >= MATERIAL_COUNT) return false;
+    }
+    return true;
+}
+
+// Children come after their parents (so the trees have no cycles), with their depths bounded by the traversal stacks.
+// Depths are tracked in the given scratch (a byte per node), the deepest parent of a node being done before it:
+bool isSceneFileBVHValid(SceneFileHeader *header, BVHNode *nodes, u32 *parent_ids, u32 *leaf_ids, u8 *depths) {
+    u32 node_count = header->bvh_node_count,
+        primitive_count = (node_count + 1) / 2,
+        left_child, parent_id;
+    u16 geo_counts[GEO_TYPE_COUNT] = {header->cube_count, header->sphere_count, header->tetrahedron_count, header->mesh_count};
+    BVHNode *node = nodes;
+    memset(depths, 0, node_count);
+    for (u32 i = 0; i < node_count; i++, node++) {
+        parent_id = parent_ids[i];
+        if (i && (parent_id >= i || (nodes[parent_id].left_child != i && nodes[parent_id].left_child + 1 != i))) return false;
+
+        left_child = node->left_child;
+        if (!left_child) {
+            if (node->geo_type >= GEO_TYPE_COUNT || node->geo_id >= geo_counts[node->geo_type]) return false;
+            continue;
+        }
+        if (left_child <= i || left_child >= node_count - 1 || depths[i] + 1 >= MAX_BVH_DEPTH) return false;
+        depths[left_child] = depths[left_child + 1] = max(depths[left_child], depths[i] + 1);
+    }
+
+    for (u32 i = 0; i < primitive_count; i++)
+        if (leaf_ids[i] >= node_count || nodes[leaf_ids[i]].left_child) return false;
+
+    return true;
+}
+
+bool isSceneFileMeshValid(Mesh *mesh, u8 *mesh_data, u8 *depths) {
+    u32 vertex_count = mesh->vertex_count,
+        node_count = mesh->bvh_node_count;
+    TriangleIndices *triangle = (TriangleIndices*)(mesh_data + (u64)mesh->triangles);
+    for (u32 i = 0; i < mesh->triangle_count; i++, triangle++)
+        if (triangle->v1 >= vertex_count || triangle->v2 >= vertex_count || triangle->v3 >= vertex_count) return false;
+
+    MeshBVHNode *node = (MeshBVHNode*)(mesh_data + (u64)mesh->bvh_nodes);
+    memset(depths, 0, node_count);
+    for (u32 i = 0; i < node_count; i++, node++) {
+        if (node->count) {
+            if ((u64)node->first + node->count > mesh->triangle_count) return false;
+            continue;
+        }
+        if (node->first <= i || node->first >= node_count - 1 || depths[i] + 1 >= MAX_BVH_DEPTH) return false;
+        depths[node->first] = depths[node->first + 1] = max(depths[node->first], depths[i] + 1);
+    }
+    return true;
+}
+
+// Points the scene's arrays (and the BVH's, when the file has one) into a mapped scene file.
+// Returns false (leaving the scene untouched) when the file can not be used as is:
+bool loadSceneFile(Scene *scene, BVH *bvh, u8 *file, u64 file_size) {
+    SceneFileHeader *header = (SceneFileHeader*)file;
+    if (file_size < sizeof(SceneFileHeader) ||
+        header->magic != SCENE_FILE_MAGIC ||
+        header->version != SCENE_FILE_VERSION) {
+        printDebugString("Unsupported scene file\n");
+        return false;
+    }
+
+    // Lights, materials and planes are sized statically (as is all of the GPU's scene):
+    if (header->point_light_count != POINT_LIGHT_COUNT ||
+        header->material_count != MATERIAL_COUNT ||
+        header->plane_count != PLANE_COUNT
+#ifdef __CUDACC__
+        || header->cube_count != CUBE_COUNT
+        || header->sphere_count != SPHERE_COUNT
+        || header->tetrahedron_count != TETRAHEDRON_COUNT
+        || header->mesh_count
+#endif
+        ) {
+        printDebugString("Scene file does not match the renderer's scene sizes\n");
+        return false;
+    }
+
+    u32 primitive_count = (u32)header->cube_count + header->sphere_count + header->tetrahedron_count + header->mesh_count;
+    bool is_valid = !header->bvh_node_count || (primitive_count && header->bvh_node_count == 2 * primitive_count - 1);
+
+    u64 sizes[SCENE_FILE_SECTION_COUNT];
+    getSceneFileSectionSizes(header, sizes);
+    SceneFileSection *section = header->sections;
+    for (u8 i = 0; i < SCENE_FILE_SECTION_COUNT; i++, section++)
+        if (section->size != sizes[i] ||
+            section->offset & (SCENE_FILE_ALIGNMENT - 1) ||
+            section->offset > file_size ||
+            section->size > file_size - section->offset)
+            is_valid = false;
+
+    // Every mesh array has to lie within the mesh data, and every mesh needs a BVH:
+    Mesh *mesh = getSceneFileSection(Mesh, file, header, SceneFileMeshes);
+    u64 mesh_data_size = header->mesh_data_size, mesh_array_sizes[MESH_ARRAY_COUNT], mesh_array_offset;
+    void **mesh_arrays[MESH_ARRAY_COUNT];
+    for (u16 i = 0; is_valid && i < header->mesh_count; i++, mesh++) {
+        mesh_arrays[0] = (void**)&mesh->vertices;
+        mesh_arrays[1] = (void**)&mesh->triangles;
+        mesh_arrays[2] = (void**)&mesh->bvh_nodes;
+        getMeshArraySizes(mesh, mesh_array_sizes);
+        if (!mesh->triangle_count || !mesh->bvh_node_count) is_valid = false;
+        for (u8 j = 0; j < MESH_ARRAY_COUNT; j++) {
+            mesh_array_offset = (u64)*mesh_arrays[j];
+            if (mesh_array_offset & (SCENE_FILE_ALIGNMENT - 1) ||
+                mesh_array_offset > mesh_data_size ||
+                mesh_array_sizes[j] > mesh_data_size - mesh_array_offset)
+                is_valid = false;
+        }
+    }
+
+    // Then the indices within the arrays (in a single pass over each, much as reading them in would take):
+    if (is_valid) {
+        Plane *plane = getSceneFileSection(Plane, file, header, SceneFilePlanes);
+        for (u8 i = 0; i < PLANE_COUNT; i++, plane++) if (plane->node.geo.material_id >= MATERIAL_COUNT) is_valid = false;
+
+        is_valid = is_valid &&
+            areSceneFileNodesValid(file, header, SceneFileCubes,      sizeof(Cube),        header->cube_count,        GeoTypeCube) &&
+            areSceneFileNodesValid(file, header, SceneFileSpheres,    sizeof(Sphere),      header->sphere_count,      GeoTypeSphere) &&
+            areSceneFileNodesValid(file, header, SceneFileTetrahedra, sizeof(Tetrahedron), header->tetrahedron_count, GeoTypeTetrahedron) &&
+            areSceneFileNodesValid(file, header, SceneFileMeshes,     sizeof(Mesh),        header->mesh_count,        GeoTypeMesh);
+
+        u32 max_node_count = header->bvh_node_count;
+        mesh = getSceneFileSection(Mesh, file, header, SceneFileMeshes);
+        for (u16 i = 0; i < header->mesh_count; i++, mesh++) max_node_count = max(max_node_count, mesh->bvh_node_count);
+
+        MemoryMarker scratch = saveMemory(&memory);
+        u8 *depths = AllocN(u8, max_node_count);
+        if (!depths) is_valid = false;
+        if (is_valid && header->bvh_node_count)
+            is_valid = isSceneFileBVHValid(header,
+                                           getSceneFileSection(BVHNode, file, header, SceneFileBVHNodes),
+                                           getSceneFileSection(u32,     file, header, SceneFileBVHParentIds),
+                                           getSceneFileSection(u32,     file, header, SceneFileBVHLeafIds),
+                                           depths);
+
+        u8 *mesh_data = getSceneFileSection(u8, file, header, SceneFileMeshData);
+        mesh = getSceneFileSection(Mesh, file, header, SceneFileMeshes);
+        for (u16 i = 0; is_valid && i < header->mesh_count; i++, mesh++) is_valid = isSceneFileMeshValid(mesh, mesh_data, depths);
+        restoreMemory(&memory, scratch);
+    }
+    if (!is_valid) {
+        printDebugString("Corrupt scene file\n");
+        return false;
+    }
+
+    initGeometryMetadata();
+    scene->cube_indices = cube_indices;
+    scene->tetrahedron_indices = tetrahedron_indices;
+    scene->cube_count = header->cube_count;
+    scene->sphere_count = header->sphere_count;
+    scene->tetrahedron_count = header->tetrahedron_count;
+    scene->mesh_count = header->mesh_count;
+    scene->ambient_light = getSceneFileSection(AmbientLight, file, header, SceneFileAmbientLight);
+    scene->point_lights  = getSceneFileSection(PointLight,   file, header, SceneFilePointLights);
+    scene->materials     = getSceneFileSection(Material,     file, header, SceneFileMaterials);
+    scene->planes        = getSceneFileSection(Plane,        file, header, SceneFilePlanes);
+    scene->cubes         = getSceneFileSection(Cube,         file, header, SceneFileCubes);
+    scene->spheres       = getSceneFileSection(Sphere,       file, header, SceneFileSpheres);
+    scene->tetrahedra    = getSceneFileSection(Tetrahedron,  file, header, SceneFileTetrahedra);
+    scene->meshes        = getSceneFileSection(Mesh,         file, header, SceneFileMeshes);
+
+    u8 *mesh_data = getSceneFileSection(u8, file, header, SceneFileMeshData);
+    mesh = scene->meshes;
+    for (u16 i = 0; i < scene->mesh_count; i++, mesh++) {
+        mesh->vertices  = (vec3*)           (mesh_data + (u64)mesh->vertices);
+        mesh->triangles = (TriangleIndices*)(mesh_data + (u64)mesh->triangles);
+        mesh->bvh_nodes = (MeshBVHNode*)    (mesh_data + (u64)mesh->bvh_nodes);
+    }
+
+    // Pointers can not be stored, so the node pointers are the only thing that gets filled in:
+    scene->node_ptrs.cubes = AllocN(NodePtr, scene->cube_count);
+    scene->node_ptrs.spheres = AllocN(NodePtr, scene->sphere_count);
+    scene->node_ptrs.tetrahedra = AllocN(NodePtr, scene->tetrahedron_count);
+    scene->node_ptrs.meshes = AllocN(NodePtr, scene->mesh_count);
+    for (u16 i = 0; i < scene->cube_count;        i++) scene->node_ptrs.cubes[i]      = &scene->cubes[i].node;
+    for (u16 i = 0; i < scene->sphere_count;      i++) scene->node_ptrs.spheres[i]    = &scene->spheres[i].node;
+    for (u16 i = 0; i < scene->tetrahedron_count; i++) scene->node_ptrs.tetrahedra[i] = &scene->tetrahedra[i].node;
+    for (u16 i = 0; i < scene->mesh_count;        i++) scene->node_ptrs.meshes[i]     = &scene->meshes[i].node;
+
+    u32 soa_sizes[SCENE_SOA_ARRAY_COUNT];
+    getSceneSoAArraySizes(header, soa_sizes);
+    scene->soa = &scene_soa;
+    f32 **soa_array = (f32**)scene->soa;
+    f32 *soa_data = getSceneFileSection(f32, file, header, SceneFileSoA);
+    for (u8 i = 0; i < SCENE_SOA_ARRAY_COUNT; i++) {
+        soa_array[i] = soa_data;
+        soa_data += soa_sizes[i];
+    }
+
+    if (header->bvh_node_count)
+        initBVHfromNodes(bvh, scene,
+                         getSceneFileSection(BVHNode, file, header, SceneFileBVHNodes),
+                         getSceneFileSection(u32,     file, header, SceneFileBVHParentIds),
+                         getSceneFileSection(u32,     file, header, SceneFileBVHLeafIds),
+                         header->bvh_area_sum,
+                         header->bvh_built_cost);
+
+#ifdef __CUDACC__
+    copySceneFromCPUtoGPU(scene);
+#endif
+
+    return true;
+}
@@ -1,125 +1,388 @@
 #pragma once
 
 #include <math.h>
+#include <string.h>
 
 #include "lib/core/types.h"
-#include "lib/shapes/line.h"
-#include "lib/shapes/bbox.h"
 #include "lib/globals/scene.h"
 #include "lib/globals/camera.h"
 #include "lib/globals/raytracing.h"
+#include "lib/shapes/line.h"
+#include "lib/shapes/bbox.h"
+#include "lib/memory/allocators.h"
 #include "lib/render/shaders/intersection/AABB.h"
 
-#define setParentAABB(parent, child_1, child_2) \
-    parent.min.x = min(child_1.min.x, child_2.min.x); \
-    parent.min.y = min(child_1.min.y, child_2.min.y); \
-    parent.min.z = min(child_1.min.z, child_2.min.z); \
-    parent.max.x = max(child_1.max.x, child_2.max.x); \
-    parent.max.y = max(child_1.max.y, child_2.max.y); \
-    parent.max.z = max(child_1.max.z, child_2.max.z)
-
-void initBVH(BVH *bvh, u8 node_count) {
-    bvh->node_count = node_count;
-    bvh->nodes = AllocN(BVHNode, MAX_BVH_NODE_COUNT);
+#define getAxis(v, axis) (((f32*)&(v))[axis])
+
+inline void resetAABB(AABB *aabb) {
+    aabb->min.x = aabb->min.y = aabb->min.z = +INFINITY;
+    aabb->max.x = aabb->max.y = aabb->max.z = -INFINITY;
 }
 
-void updateBVH(BVH *bvh, Scene *scene) {
-    AABB cube_aabbs[CUBE_COUNT];
-    AABB sphere_aabbs[SPHERE_COUNT];
-    AABB tet_aabbs[TETRAHEDRON_COUNT];
+inline void growAABB(AABB *aabb, AABB *other) {
+    aabb->min.x = min(aabb->min.x, other->min.x);
+    aabb->min.y = min(aabb->min.y, other->min.y);
+    aabb->min.z = min(aabb->min.z, other->min.z);
+    aabb->max.x = max(aabb->max.x, other->max.x);
+    aabb->max.y = max(aabb->max.y, other->max.y);
+    aabb->max.z = max(aabb->max.z, other->max.z);
+}
+
+inline void growAABBbyPoint(AABB *aabb, vec3 *point) {
+    aabb->min.x = min(aabb->min.x, point->x);
+    aabb->min.y = min(aabb->min.y, point->y);
+    aabb->min.z = min(aabb->min.z, point->z);
+    aabb->max.x = max(aabb->max.x, point->x);
+    aabb->max.y = max(aabb->max.y, point->y);
+    aabb->max.z = max(aabb->max.z, point->z);
+}
+
+// Half the surface area (the factor of 2 cancels out in the SAH):
+inline f32 getAABBArea(AABB *aabb) {
+    f32 x = aabb->max.x - aabb->min.x,
+        y = aabb->max.y - aabb->min.y,
+        z = aabb->max.z - aabb->min.z;
+    return x*y + y*z + z*x;
+}
+
+// Returns false (leaving the BVH empty) when there is no geometry to build it over, or not enough memory for it
+// (including for the scratch of its builds, which comes from the frame's memory, see updateBVH):
+bool initBVH(BVH *bvh, u32 primitive_count) {
+    MemoryMarker marker = saveMemory(&memory);
+    bvh->primitive_count = bvh->node_count = 0;
+    bvh->primitives = 0;
+    if (primitive_count && sizeof(BVHPrimitive) * primitive_count <= frame_memory.capacity) {
+        bvh->nodes = AllocN(BVHNode, 2 * primitive_count - 1);
+        bvh->parent_ids = AllocN(u32, 2 * primitive_count - 1);
+        bvh->leaf_ids = AllocN(u32, primitive_count);
+        if (bvh->nodes && bvh->parent_ids && bvh->leaf_ids) {
+            bvh->primitive_count = primitive_count;
+            return true;
+        }
+    }
+
+    restoreMemory(&memory, marker);
+    bvh->nodes = 0;
+    bvh->parent_ids = bvh->leaf_ids = 0;
+    return false;
+}
 
-    for (u8 i = 0; i < CUBE_COUNT;        i++) setAABBfromNode(cube_aabbs   + i, &scene->cubes[i].node);
-    for (u8 i = 0; i < SPHERE_COUNT;      i++) setAABBfromNode(sphere_aabbs + i, &scene->spheres[i].node);
-    for (u8 i = 0; i < TETRAHEDRON_COUNT; i++) setAABBfromNode(tet_aabbs    + i, &scene->tetrahedra[i].node);
+// Primitives are gathered by geometry type (cubes, then spheres, then tetrahedra):
+#define getBVHPrimitiveIndex(bvh, geo_type, geo_id) ((bvh)->geo_offsets[geo_type] + (geo_id))
 
-    setParentAABB(bvh->nodes[1].aabb, tet_aabbs[0], tet_aabbs[1]);
-    setParentAABB(bvh->nodes[2].aabb, tet_aabbs[2], tet_aabbs[3]);
+typedef struct {
+    AABB aabb;
+    u32 count;
+} BVHBin;
 
-    bvh->nodes[1].geo_type = GeoTypeTetrahedron;
-    bvh->nodes[2].geo_type = GeoTypeTetrahedron;
-    bvh->nodes[1].geo_ids = 1 | 2;
-    bvh->nodes[2].geo_ids = 4 | 8;
+// Returns the index that splits primitives[0..count) into 2 non-empty groups along the cheapest SAH plane.
+// Falls back to a median split along the widest axis when the centroids can not be told apart,
+// or when the tree gets too deep for the traversal stack.
+u32 partitionBVHPrimitives(BVHPrimitive *primitives, u32 count, u8 depth) {
+    AABB centroid_bounds, left_aabb, right_aabb;
+    BVHBin bins[BVH_BIN_COUNT];
+    f32 left_areas[BVH_BIN_COUNT];
+    u32 left_counts[BVH_BIN_COUNT];
+    u32 i, bin, left_count, right_count, split_count;
+    f32 cost, best_cost = +INFINITY, extent, widest_extent = 0, bin_scale, bin_min;
+    u8 axis, best_axis = 0, widest_axis = 0, best_bin = 0;
+    BVHPrimitive temp;
 
+    resetAABB(&centroid_bounds);
+    for (i = 0; i < count; i++) growAABBbyPoint(&centroid_bounds, &primitives[i].centroid);
 
-    setParentAABB(bvh->nodes[3].aabb, cube_aabbs[0], cube_aabbs[1]);
-    setParentAABB(bvh->nodes[4].aabb, cube_aabbs[2], cube_aabbs[3]);
+    for (axis = 0; axis < 3; axis++) {
+        bin_min = getAxis(centroid_bounds.min, axis);
+        extent = getAxis(centroid_bounds.max, axis) - bin_min;
+        if (extent > widest_extent) {
+            widest_extent = extent;
+            widest_axis = axis;
+        }
+        if (extent <= 0 || depth >= MAX_BVH_DEPTH / 2) continue;
 
-    bvh->nodes[3].geo_type = GeoTypeCube;
-    bvh->nodes[4].geo_type = GeoTypeCube;
-    bvh->nodes[3].geo_ids = 1 | 2;
-    bvh->nodes[4].geo_ids = 4 | 8;
+        for (bin = 0; bin < BVH_BIN_COUNT; bin++) {
+            resetAABB(&bins[bin].aabb);
+            bins[bin].count = 0;
+        }
 
-    setParentAABB(bvh->nodes[5].aabb, sphere_aabbs[0], sphere_aabbs[1]);
-    setParentAABB(bvh->nodes[6].aabb, sphere_aabbs[2], sphere_aabbs[3]);
+        bin_scale = BVH_BIN_COUNT / extent;
+        for (i = 0; i < count; i++) {
+            bin = (u32)((getAxis(primitives[i].centroid, axis) - bin_min) * bin_scale);
+            if (bin >= BVH_BIN_COUNT) bin = BVH_BIN_COUNT - 1;
+            bins[bin].count++;
+            growAABB(&bins[bin].aabb, &primitives[i].aabb);
+        }
 
-    bvh->nodes[5].geo_type = GeoTypeSphere;
-    bvh->nodes[6].geo_type = GeoTypeSphere;
-    bvh->nodes[5].geo_ids = 1 | 2;
-    bvh->nodes[6].geo_ids = 4 | 8;
+        // Sweep from the left, then from the right evaluating the cost of splitting after each bin:
+        resetAABB(&left_aabb);
+        left_count = 0;
+        for (bin = 0; bin < BVH_BIN_COUNT - 1; bin++) {
+            left_count += bins[bin].count;
+            growAABB(&left_aabb, &bins[bin].aabb);
+            left_counts[bin] = left_count;
+            left_areas[bin] = left_count ? getAABBArea(&left_aabb) : 0;
+        }
 
-    AABB spheres_aabb, cubes_aabb, tetrahedra_aabb;
-    setParentAABB(tetrahedra_aabb, bvh->nodes[1].aabb, bvh->nodes[2].aabb);
-    setParentAABB(cubes_aabb, bvh->nodes[3].aabb, bvh->nodes[4].aabb);
-    setParentAABB(spheres_aabb, bvh->nodes[5].aabb, bvh->nodes[6].aabb);
-    setParentAABB(bvh->nodes[0].aabb, spheres_aabb, cubes_aabb);
-    setParentAABB(bvh->nodes[0].aabb, bvh->nodes[0].aabb, tetrahedra_aabb);
+        resetAABB(&right_aabb);
+        right_count = 0;
+        for (bin = BVH_BIN_COUNT - 1; bin > 0; bin--) {
+            right_count += bins[bin].count;
+            growAABB(&right_aabb, &bins[bin].aabb);
+            if (!right_count || !left_counts[bin - 1]) continue;
 
-    bvh->nodes->geo_type = 0;
-    bvh->nodes->geo_ids = 0;
-    bvh->nodes->children = 1 | 2 | 4 | 8 | 16 | 32;
+            cost = left_areas[bin - 1] * left_counts[bin - 1] + getAABBArea(&right_aabb) * right_count;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = (u8)bin;
+            }
+        }
+    }
+
+    if (best_cost < +INFINITY) {
+        bin_min = getAxis(centroid_bounds.min, best_axis);
+        bin_scale = BVH_BIN_COUNT / (getAxis(centroid_bounds.max, best_axis) - bin_min);
+        split_count = 0;
+        for (i = 0; i < count; i++) {
+            bin = (u32)((getAxis(primitives[i].centroid, best_axis) - bin_min) * bin_scale);
+            if (bin >= BVH_BIN_COUNT) bin = BVH_BIN_COUNT - 1;
+            if (bin < best_bin) {
+                temp = primitives[i];
+                primitives[i] = primitives[split_count];
+                primitives[split_count++] = temp;
+            }
+        }
+        return split_count;
+    }
+
+    // Median split (quick-select the middle centroid along the widest axis):
+    u32 left = 0, right = count - 1, middle = count / 2, j;
+    f32 pivot;
+    while (left < right) {
+        pivot = getAxis(primitives[(left + right) / 2].centroid, widest_axis);
+        i = left;
+        j = right;
+        while (i <= j) {
+            while (getAxis(primitives[i].centroid, widest_axis) < pivot) i++;
+            while (getAxis(primitives[j].centroid, widest_axis) > pivot) j--;
+            if (i <= j) {
+                temp = primitives[i];
+                primitives[i++] = primitives[j];
+                primitives[j] = temp;
+                if (!j) break;
+                j--;
+            }
+        }
+        if (middle <= j) right = j;
+        else if (middle >= i) left = i;
+        else break;
+    }
+    return middle;
+}
+
+void buildBVHNode(BVH *bvh, u32 node_id, u32 first, u32 count, u8 depth) {
+    BVHNode *node = bvh->nodes + node_id;
+    BVHPrimitive *primitives = bvh->primitives + first;
+
+    resetAABB(&node->aabb);
+    for (u32 i = 0; i < count; i++) growAABB(&node->aabb, &primitives[i].aabb);
+    bvh->area_sum += getAABBArea(&node->aabb);
+
+    if (count == 1) {
+        node->left_child = 0;
+        node->geo_type = primitives->geo_type;
+        node->geo_id = primitives->geo_id;
+        bvh->leaf_ids[getBVHPrimitiveIndex(bvh, node->geo_type, node->geo_id)] = node_id;
+        return;
+    }
+
+    u32 left_count = partitionBVHPrimitives(primitives, count, depth);
+    node->left_child = bvh->node_count;
+    node->geo_type = node->geo_id = 0;
+    bvh->parent_ids[node->left_child] = bvh->parent_ids[node->left_child + 1] = node_id;
+    bvh->node_count += 2;
+
+    buildBVHNode(bvh, node->left_child,     first,              left_count,         depth + 1);
+    buildBVHNode(bvh, node->left_child + 1, first + left_count, count - left_count, depth + 1);
+}
+
+inline void setBVHPrimitive(BVHPrimitive *primitive, Node *node, u8 geo_type, u16 geo_id) {
+    setAABBfromNode(&primitive->aabb, node);
+    primitive->centroid = node->position;
+    primitive->geo_type = geo_type;
+    primitive->geo_id = geo_id;
+}
+
+inline void setBVHGeoOffsets(BVH *bvh, Scene *scene) {
+    bvh->geo_offsets[GeoTypeCube] = 0;
+    bvh->geo_offsets[GeoTypeSphere] = scene->cube_count;
+    bvh->geo_offsets[GeoTypeTetrahedron] = scene->cube_count + scene->sphere_count;
+    bvh->geo_offsets[GeoTypeMesh] = scene->cube_count + scene->sphere_count + scene->tetrahedron_count;
+}
+
+// An empty BVH (see initBVH) stays empty, traversals skip it.
+// The primitives are build scratch, released once the tree is built (the current tree stays when they do not fit):
+void updateBVH(BVH *bvh, Scene *scene) {
+    if (!bvh->primitive_count) return;
+
+    MemoryMarker scratch = saveMemory(&frame_memory);
+    bvh->primitives = AllocFrameN(BVHPrimitive, bvh->primitive_count);
+    if (!bvh->primitives) return;
+
+    BVHPrimitive *primitive = bvh->primitives;
+    for (u16 i = 0; i < scene->cube_count;        i++) setBVHPrimitive(primitive++, &scene->cubes[i].node,      GeoTypeCube,        i);
+    for (u16 i = 0; i < scene->sphere_count;      i++) setBVHPrimitive(primitive++, &scene->spheres[i].node,    GeoTypeSphere,      i);
+    for (u16 i = 0; i < scene->tetrahedron_count; i++) setBVHPrimitive(primitive++, &scene->tetrahedra[i].node, GeoTypeTetrahedron, i);
+    for (u16 i = 0; i < scene->mesh_count;        i++) setBVHPrimitive(primitive++, &scene->meshes[i].node,     GeoTypeMesh,        i);
+
+    setBVHGeoOffsets(bvh, scene);
+    bvh->node_count = 1;
+    bvh->area_sum = 0;
+    buildBVHNode(bvh, 0, 0, bvh->primitive_count, 0);
+    bvh->built_cost = bvh->area_sum / getAABBArea(&bvh->nodes->aabb);
+    restoreMemory(&frame_memory, scratch);
+    bvh->primitives = 0;
 #ifdef __CUDACC__
     copyBVHNodesFromCPUtoGPU(bvh->nodes);
 #endif
 }
 
+// Uses a prebuilt tree of the scene (as stored in scene files) in place:
+void initBVHfromNodes(BVH *bvh, Scene *scene, BVHNode *nodes, u32 *parent_ids, u32 *leaf_ids, f32 area_sum, f32 built_cost) {
+    bvh->primitive_count = getSceneGeometryCount(scene);
+    bvh->node_count = 2 * bvh->primitive_count - 1;
+    bvh->nodes = nodes;
+    bvh->parent_ids = parent_ids;
+    bvh->leaf_ids = leaf_ids;
+    bvh->primitives = 0;
+    bvh->area_sum = area_sum;
+    bvh->built_cost = built_cost;
+    setBVHGeoOffsets(bvh, scene);
 #ifdef __CUDACC__
-__device__
-__host__
-__forceinline__
-#else
-inline
+    copyBVHNodesFromCPUtoGPU(bvh->nodes);
 #endif
-GeometryMasks getRayVisibilityMasksFromBVH(vec3 *Ro, vec3 *RD_rcp, BVHNode *bvh_nodes) {
-    BVHNode *node = bvh_nodes;
-    u8 i, child, next_children, children = node->children;
-    GeometryMasks visibility;
-    visibility.spheres = visibility.cubes = visibility.tetrahedra = 0;
-
-    while (children) { // Breadth-first_traversal
-        next_children = 0;
-        child = 1;
-
-        for (i = 0; i < 8; i++, child <<= (u8)1)
-            if (child & children) {
-                node = &bvh_nodes[i + 1];
-                if (hitAABB(&node->aabb.min, &node->aabb.max, Ro, RD_rcp)) {
-                    next_children |= node->children;
-                    switch (node->geo_type) {
-                        case GeoTypeCube       : visibility.cubes      |= node->geo_ids; break;
-                        case GeoTypeSphere     : visibility.spheres    |= node->geo_ids; break;
-                        case GeoTypeTetrahedron: visibility.tetrahedra |= node->geo_ids; break;
-                    }
-                }
-            }
+}
+
+// Mesh BVHs:
+// =========
+// Built with the same binned SAH partitioning, over the mesh's triangles (in mesh space).
+void buildMeshBVHNode(Mesh *mesh, BVHPrimitive *primitives, u32 node_id, u32 first, u32 count, u8 depth) {
+    MeshBVHNode *node = mesh->bvh_nodes + node_id;
+    primitives += first;
+
+    resetAABB(&node->aabb);
+    for (u32 i = 0; i < count; i++) growAABB(&node->aabb, &primitives[i].aabb);
+
+    if (count <= MESH_BVH_LEAF_SIZE) {
+        node->first = first;
+        node->count = count;
+        return;
+    }
+
+    u32 left_count = partitionBVHPrimitives(primitives, count, depth);
+    node->first = mesh->bvh_node_count;
+    node->count = 0;
+    mesh->bvh_node_count += 2;
+
+    buildMeshBVHNode(mesh, primitives - first, node->first,     first,              left_count,         depth + 1);
+    buildMeshBVHNode(mesh, primitives - first, node->first + 1, first + left_count, count - left_count, depth + 1);
+}
 
-        children = next_children;
+// The primitives and the copy of the triangles are build scratch, released once the nodes are moved over them.
+// Returns false for meshes without triangles, or when the memory runs out:
+bool buildMeshBVH(Mesh *mesh) {
+    u32 count = mesh->triangle_count;
+    if (!count) return false;
+    MemoryMarker scratch = saveMemory(&memory);
+
+    BVHPrimitive *primitive, *primitives = AllocN(BVHPrimitive, count);
+    TriangleIndices *triangle, *triangles = AllocN(TriangleIndices, count);
+    mesh->bvh_nodes = AllocN(MeshBVHNode, 2 * count - 1);
+    if (!primitives || !triangles || !mesh->bvh_nodes) {
+        restoreMemory(&memory, scratch);
+        return false;
+    }
+    memcpy(triangles, mesh->triangles, sizeof(TriangleIndices) * count);
+
+    primitive = primitives;
+    triangle = triangles;
+    for (u32 i = 0; i < count; i++, primitive++, triangle++) {
+        resetAABB(&primitive->aabb);
+        growAABBbyPoint(&primitive->aabb, mesh->vertices + triangle->v1);
+        growAABBbyPoint(&primitive->aabb, mesh->vertices + triangle->v2);
+        growAABBbyPoint(&primitive->aabb, mesh->vertices + triangle->v3);
+        primitive->centroid.x = (primitive->aabb.min.x + primitive->aabb.max.x) * 0.5f;
+        primitive->centroid.y = (primitive->aabb.min.y + primitive->aabb.max.y) * 0.5f;
+        primitive->centroid.z = (primitive->aabb.min.z + primitive->aabb.max.z) * 0.5f;
+        primitive->geo_type = GeoTypeMesh;
+        primitive->geo_id = i;
     }
 
-    return visibility;
+    mesh->bvh_node_count = 1;
+    buildMeshBVHNode(mesh, primitives, 0, 0, count, 0);
+
+    // Leaves reference ranges of triangles, so triangles are stored in the order they were partitioned into:
+    for (u32 i = 0; i < count; i++) mesh->triangles[i] = triangles[primitives[i].geo_id];
+
+    MeshBVHNode *nodes = mesh->bvh_nodes;
+    restoreMemory(&memory, scratch);
+    mesh->bvh_nodes = AllocN(MeshBVHNode, mesh->bvh_node_count);
+    memmove(mesh->bvh_nodes, nodes, sizeof(MeshBVHNode) * mesh->bvh_node_count);
+    return true;
+}
+
+// Re-fits the leaf of a node that moved and its ancestors, stopping once an ancestor's AABB is unchanged:
+void refitBVHLeaf(BVH *bvh, Node *scene_node) {
+    u32 node_id = bvh->leaf_ids[getBVHPrimitiveIndex(bvh, scene_node->geo.type, scene_node->geo.id)];
+    BVHNode *node = bvh->nodes + node_id;
+    AABB aabb;
+
+    bvh->area_sum -= getAABBArea(&node->aabb);
+    setAABBfromNode(&node->aabb, scene_node);
+    bvh->area_sum += getAABBArea(&node->aabb);
+
+    while (node_id) {
+        node_id = bvh->parent_ids[node_id];
+        node = bvh->nodes + node_id;
+
+        aabb = bvh->nodes[node->left_child].aabb;
+        growAABB(&aabb, &bvh->nodes[node->left_child + 1].aabb);
+        if (!memcmp(&aabb, &node->aabb, sizeof(AABB))) break;
+
+        bvh->area_sum += getAABBArea(&aabb) - getAABBArea(&node->aabb);
+        node->aabb = aabb;
+    }
+}
+
+// Re-fits the tree for the given moved nodes, rebuilding it instead once refitting has degraded it too much:
+void refitBVH(BVH *bvh, Scene *scene, Node **moved_nodes, u32 moved_node_count) {
+    if (!bvh->node_count) return;
+
+    for (u32 i = 0; i < moved_node_count; i++) refitBVHLeaf(bvh, moved_nodes[i]);
+
+    if (bvh->area_sum / getAABBArea(&bvh->nodes->aabb) > bvh->built_cost * BVH_REBUILD_RATIO)
+        updateBVH(bvh, scene);
+#ifdef __CUDACC__
+    else
+        copyBVHNodesFromCPUtoGPU(bvh->nodes);
+#endif
 }
 
 void drawBVH(BVH *bvh, Camera *camera) {
+    if (!bvh->node_count) return;
+
     BBox bbox;
     BVHNode *node = bvh->nodes + 1;
     Pixel pixel;
-    for (u8 node_id = 1; node_id < bvh->node_count; node_id++, node++) {
+    for (u32 node_id = 1; node_id < bvh->node_count; node_id++, node++) {
         setBBoxFromAABB(&node->aabb, &bbox);
         projectBBox(&bbox, camera);
-        switch (node->geo_type) {
+        if (node->left_child) pixel.color = WHITE;
+        else switch (node->geo_type) {
             case GeoTypeCube: pixel.color = CYAN; break;
             case GeoTypeSphere: pixel.color = YELLOW; break;
             case GeoTypeTetrahedron: pixel.color = MAGENTA; break;
-            default: pixel.color = WHITE; break;
+            case GeoTypeMesh: pixel.color = GREEN; break;
         }
         drawBBox(&bbox, pixel);
     }
@@ -7,6 +7,7 @@
 #include "lib/globals/camera.h"
 #include "lib/globals/display.h"
 #include "lib/globals/raytracing.h"
+#include "lib/memory/worker_allocators.h"
 
 #ifdef __CUDACC__
 __device__
@@ -15,22 +16,48 @@ __forceinline__
 #else
 inline
 #endif
-u8 getVisibilityMasksFromBounds(Bounds2Di *bounds, u8 node_count, u8 node_visibility, u16 x, u16 y) {
-    u8 ray_visibility_mask = 0;
-    u8 node_id = 1;
-
-    for (u8 i = 0; i < node_count; i++, node_id <<= (u8)1, bounds++)
-        if (node_visibility & node_id &&
-            x >= bounds->x_range.min &&
-            x <= bounds->x_range.max &&
-            y >= bounds->y_range.min &&
-            y <= bounds->y_range.max)
-            ray_visibility_mask |= node_id;
-
-    return ray_visibility_mask;
+bool isInBounds(Bounds2Di *bounds, u16 x, u16 y) {
+    return x >= bounds->x_range.min &&
+           x <= bounds->x_range.max &&
+           y >= bounds->y_range.min &&
+           y <= bounds->y_range.max;
 }
 
-bool computeSSB(Bounds2Di *bounds, f32 x, f32 y, f32 z, f32 r, f32 focal_length) {
+// The id lists come from the calling worker's arena, sized for all of the scene's geometry:
+inline void allocateTileGeometry(TileGeometry *tile, Scene *scene) {
+    tile->cubes.ids         = AllocWorkerN(u16, scene->cube_count);
+    tile->spheres.ids       = AllocWorkerN(u16, scene->sphere_count);
+    tile->tetrahedra.ids    = AllocWorkerN(u16, scene->tetrahedron_count);
+    tile->meshes.ids        = AllocWorkerN(u16, scene->mesh_count);
+    tile->sphere_lanes      = AllocWorkerN(u8,  scene->sphere_count);
+    tile->cube_lanes        = AllocWorkerN(u8,  scene->cube_count);
+    tile->tetrahedron_lanes = AllocWorkerN(u8,  scene->tetrahedron_count);
+}
+
+// Gathers the ids of the visible geometry whose bounds overlap the given tile (so pixels only check those):
+inline void gatherTileGeometryIds(GeometryIds *tile_ids, Bounds2Di *bounds, u64 *visibility, u16 count,
+                                  u16 min_x, u16 min_y, u16 max_x, u16 max_y) {
+    tile_ids->count = 0;
+    for (u16 i = 0; i < count; i++, bounds++)
+        if (testBit(visibility, i) &&
+            bounds->x_range.min <= max_x &&
+            bounds->x_range.max >= min_x &&
+            bounds->y_range.min <= max_y &&
+            bounds->y_range.max >= min_y)
+            tile_ids->ids[tile_ids->count++] = i;
+}
+
+void gatherTileGeometry(TileGeometry *tile, Scene *scene, GeometryBounds *bounds, Masks *masks,
+                        u16 min_x, u16 min_y, u16 max_x, u16 max_y) {
+    gatherTileGeometryIds(&tile->cubes,      bounds->cubes,      masks->visibility.cubes,      scene->cube_count,        min_x, min_y, max_x, max_y);
+    gatherTileGeometryIds(&tile->spheres,    bounds->spheres,    masks->visibility.spheres,    scene->sphere_count,      min_x, min_y, max_x, max_y);
+    gatherTileGeometryIds(&tile->tetrahedra, bounds->tetrahedra, masks->visibility.tetrahedra, scene->tetrahedron_count, min_x, min_y, max_x, max_y);
+    gatherTileGeometryIds(&tile->meshes,     bounds->meshes,     masks->visibility.meshes,     scene->mesh_count,        min_x, min_y, max_x, max_y);
+}
+
+// The extents of the projection of a sphere in front of the camera (at x, y, z in view space), in normalized device
+// coordinates (from -1 to 1 across the screen, bottom to top, not clipped to it):
+void projectSphere(f32 x, f32 y, f32 z, f32 r, f32 focal_length, f32 *left, f32 *right, f32 *bottom, f32 *top) {
 /*
  h = y - t
  HH = zz + tt
@@ -79,47 +106,59 @@ bool computeSSB(Bounds2Di *bounds, f32 x, f32 y, f32 z, f32 r, f32 focal_length)
   s1 = f(yz - sqr)
   s2 = f(yz + sqr)
 */
-    bounds->x_range.min = frame_buffer.dimentions.width + 1;
-    bounds->x_range.max = frame_buffer.dimentions.width + 1;
-    bounds->y_range.max = frame_buffer.dimentions.height + 1;
-    bounds->y_range.min = frame_buffer.dimentions.height + 1;
-
     f32 den = z*z - r*r;
     f32 factor = focal_length / den;
 
     f32 xz = x * z;
     f32 sqr = r * sqrtf(x*x + den);
-    f32 left  = factor*(xz - sqr);
-    f32 right = factor*(xz + sqr);
-    if (left < 1 && right > -1) {
-        factor *= frame_buffer.dimentions.width_over_height;
-
-        f32 yz = y * z;
-        sqr = r * sqrtf(y*y + den);
-        f32 bottom = factor*(yz - sqr);
-        f32 top    = factor*(yz + sqr);
-        if (bottom < 1 && top > -1) {
-            bottom = bottom > -1 ? bottom : -1; bottom += 1;
-            top    = top < 1 ? top : 1; top    += 1;
-            left   = left > -1 ? left : -1; left   += 1;
-            right  = right < 1 ? right : 1; right  += 1;
-
-            top    = 2 - top;
-            bottom = 2 - bottom;
-
-            bounds->x_range.min = (u16)(frame_buffer.dimentions.h_width * left);
-            bounds->x_range.max = (u16)(frame_buffer.dimentions.h_width * right);
-            bounds->y_range.max = (u16)(frame_buffer.dimentions.h_height * bottom);
-            bounds->y_range.min = (u16)(frame_buffer.dimentions.h_height * top);
-            return true;
-        }
-    }
+    *left  = factor*(xz - sqr);
+    *right = factor*(xz + sqr);
+
+    factor *= frame_buffer.dimentions.width_over_height;
+
+    f32 yz = y * z;
+    sqr = r * sqrtf(y*y + den);
+    *bottom = factor*(yz - sqr);
+    *top    = factor*(yz + sqr);
+}
+
+inline bool isOnScreen(f32 left, f32 right, f32 bottom, f32 top) {
+    return left < 1 && right > -1 && bottom < 1 && top > -1;
+}
+
+// Clips the extents (as given by projectSphere) to the screen, as bounds in pixels:
+void setScreenBounds(Bounds2Di *bounds, f32 left, f32 right, f32 bottom, f32 top) {
+    bottom = bottom > -1 ? bottom : -1; bottom += 1;
+    top    = top < 1 ? top : 1; top    += 1;
+    left   = left > -1 ? left : -1; left   += 1;
+    right  = right < 1 ? right : 1; right  += 1;
+
+    top    = 2 - top;
+    bottom = 2 - bottom;
 
-    return false;
+    bounds->x_range.min = (u16)(frame_buffer.dimentions.h_width * left);
+    bounds->x_range.max = (u16)(frame_buffer.dimentions.h_width * right);
+    bounds->y_range.max = (u16)(frame_buffer.dimentions.h_height * bottom);
+    bounds->y_range.min = (u16)(frame_buffer.dimentions.h_height * top);
+}
+
+bool computeSSB(Bounds2Di *bounds, f32 x, f32 y, f32 z, f32 r, f32 focal_length) {
+    bounds->x_range.min = frame_buffer.dimentions.width + 1;
+    bounds->x_range.max = frame_buffer.dimentions.width + 1;
+    bounds->y_range.max = frame_buffer.dimentions.height + 1;
+    bounds->y_range.min = frame_buffer.dimentions.height + 1;
+
+    f32 left, right, bottom, top;
+    projectSphere(x, y, z, r, focal_length, &left, &right, &bottom, &top);
+    if (!isOnScreen(left, right, bottom, top)) return false;
+
+    setScreenBounds(bounds, left, right, bottom, top);
+    return true;
 }
 
 void updateSceneMasks(Scene* scene, SSB* ssb, Masks *masks, f32 focal_length) {
-    u8 node_id, geo_count, transparency_mask, *visibility_mask;
+    u16 geo_count;
+    u64 *transparency_mask, *visibility_mask;
     f32 r, z;
     vec3 *p;
     Bounds2Di *b;
@@ -128,52 +167,65 @@ void updateSceneMasks(Scene* scene, SSB* ssb, Masks *masks, f32 focal_length) {
     for (u8 geo_type = 0; geo_type < GEO_TYPE_COUNT; geo_type++) {
         switch (geo_type) {
             case GeoTypeCube:
-                geo_count = CUBE_COUNT;
+                geo_count = scene->cube_count;
                 node_ptr = scene->node_ptrs.cubes;
                 transparency_mask = masks->transparency.cubes;
-                visibility_mask = &masks->visibility.cubes;
+                visibility_mask = masks->visibility.cubes;
                 p = ssb->view_positions.cubes;
                 b = ssb->bounds.cubes;
                 break;
             case GeoTypeSphere:
-                geo_count = SPHERE_COUNT;
+                geo_count = scene->sphere_count;
                 node_ptr = scene->node_ptrs.spheres;
                 transparency_mask = masks->transparency.spheres;
-                visibility_mask = &masks->visibility.spheres;
+                visibility_mask = masks->visibility.spheres;
                 p = ssb->view_positions.spheres;
                 b = ssb->bounds.spheres;
                 break;
             case GeoTypeTetrahedron:
-                geo_count = TETRAHEDRON_COUNT;
+                geo_count = scene->tetrahedron_count;
                 node_ptr = scene->node_ptrs.tetrahedra;
                 transparency_mask = masks->transparency.tetrahedra;
-                visibility_mask = &masks->visibility.tetrahedra;
+                visibility_mask = masks->visibility.tetrahedra;
                 p = ssb->view_positions.tetrahedra;
                 b = ssb->bounds.tetrahedra;
                 break;
+            case GeoTypeMesh:
+                geo_count = scene->mesh_count;
+                node_ptr = scene->node_ptrs.meshes;
+                transparency_mask = masks->transparency.meshes;
+                visibility_mask = masks->visibility.meshes;
+                p = ssb->view_positions.meshes;
+                b = ssb->bounds.meshes;
+                break;
             default:
                 continue;
         }
 
-        *visibility_mask = 0;
-        node_id = 1;
+        clearBitset(visibility_mask, geo_count);
 
-        for (u8 i = 0; i < geo_count; i++, p++, b++, node_ptr++, node_id <<= (u8)1) {
+        for (u16 i = 0; i < geo_count; i++, p++, b++, node_ptr++) {
             node = *node_ptr;
             r = node->radius;
             z = p->z;
 
-            if ((transparency_mask & node_id ? (z > -r) : (z > r)) &&
+            if ((testBit(transparency_mask, i) ? (z > -r) : (z > r)) &&
                 computeSSB(b, p->x, p->y, p->z, r, focal_length)) {
 
-                *visibility_mask |= node_id;
+                setBit(visibility_mask, i);
+            } else if (geo_type == GeoTypeMesh && z > -r) {
+                // Meshes can be large enough to surround the camera, their bounds then cover the whole screen:
+                b->x_range.min = b->y_range.min = 0;
+                b->x_range.max = frame_buffer.dimentions.width - 1;
+                b->y_range.max = frame_buffer.dimentions.height - 1;
+                setBit(visibility_mask, i);
             }
         }
     }
 
-    masks->visibility.cubes = 0;
-//    masks->visibility.spheres = 0;
-    masks->visibility.tetrahedra = 0;
+    clearBitset(masks->visibility.cubes, scene->cube_count);
+//    clearBitset(masks->visibility.spheres, scene->sphere_count);
+    clearBitset(masks->visibility.tetrahedra, scene->tetrahedron_count);
 
 #ifdef __CUDACC__
     copyMasksFromCPUtoGPU(masks);
@@ -181,7 +233,7 @@ void updateSceneMasks(Scene* scene, SSB* ssb, Masks *masks, f32 focal_length) {
 #endif
 }
 
-void drawSSB(SSB* ssb) {
+void drawSSB(SSB* ssb, Scene *scene) {
     Pixel pixel;
     pixel.color.R = MAX_COLOR_VALUE;
     pixel.color.G = MAX_COLOR_VALUE;
@@ -189,7 +241,7 @@ void drawSSB(SSB* ssb) {
     pixel.color.A = 0;
 
     Bounds2Di *bounds = ssb->bounds.spheres;
-    for (u8 i = 0; i < SPHERE_COUNT; i++, bounds++) {
+    for (u16 i = 0; i < scene->sphere_count; i++, bounds++) {
         drawHLine2D(bounds->x_range.min, bounds->x_range.max, bounds->y_range.min, pixel);
         drawHLine2D(bounds->x_range.min, bounds->x_range.max, bounds->y_range.max, pixel);
         drawVLine2D(bounds->y_range.min, bounds->y_range.max, bounds->x_range.min, pixel);
@@ -201,7 +253,7 @@ void drawSSB(SSB* ssb) {
     pixel.color.B = MAX_COLOR_VALUE;
 
     bounds = ssb->bounds.tetrahedra;
-    for (u8 i = 0; i < TETRAHEDRON_COUNT; i++, bounds++) {
+    for (u16 i = 0; i < scene->tetrahedron_count; i++, bounds++) {
         drawHLine2D(bounds->x_range.min, bounds->x_range.max, bounds->y_range.min, pixel);
         drawHLine2D(bounds->x_range.min, bounds->x_range.max, bounds->y_range.max, pixel);
         drawVLine2D(bounds->y_range.min, bounds->y_range.max, bounds->x_range.min, pixel);
@@ -213,7 +265,19 @@ void drawSSB(SSB* ssb) {
     pixel.color.B = MAX_COLOR_VALUE;
 
     bounds = ssb->bounds.cubes;
-    for (u8 i = 0; i < CUBE_COUNT; i++, bounds++) {
+    for (u16 i = 0; i < scene->cube_count; i++, bounds++) {
+        drawHLine2D(bounds->x_range.min, bounds->x_range.max, bounds->y_range.min, pixel);
+        drawHLine2D(bounds->x_range.min, bounds->x_range.max, bounds->y_range.max, pixel);
+        drawVLine2D(bounds->y_range.min, bounds->y_range.max, bounds->x_range.min, pixel);
+        drawVLine2D(bounds->y_range.min, bounds->y_range.max, bounds->x_range.max, pixel);
+    }
+
+    pixel.color.R = 0;
+    pixel.color.G = MAX_COLOR_VALUE;
+    pixel.color.B = 0;
+
+    bounds = ssb->bounds.meshes;
+    for (u16 i = 0; i < scene->mesh_count; i++, bounds++) {
         drawHLine2D(bounds->x_range.min, bounds->x_range.max, bounds->y_range.min, pixel);
         drawHLine2D(bounds->x_range.min, bounds->x_range.max, bounds->y_range.max, pixel);
         drawVLine2D(bounds->y_range.min, bounds->y_range.max, bounds->x_range.min, pixel);
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "lib/core/types.h"
+#include "lib/core/threads.h"
+#include "lib/globals/app.h"
+#include "lib/globals/display.h"
+#include "lib/globals/scene.h"
+#include "lib/globals/timers.h"
+#include "lib/render/raytracer.h"
+
+inline void swapFrameBuffers() {
+    FrameBuffer window_frame_buffer = frame_buffer;
+    frame_buffer = dynamic_resolution.frame_buffer;
+    dynamic_resolution.frame_buffer = window_frame_buffer;
+    dynamic_resolution.is_swapped = !dynamic_resolution.is_swapped;
+}
+
+// Blends 2 pixels by a weight out of 256, 2 channels at a time:
+inline u32 lerpPixels(u32 from, u32 to, u32 weight) {
+    return (((from & 0xFF00FF) * (256 - weight) + (to & 0xFF00FF) * weight) >> 8 & 0xFF00FF) |
+           (((from >> 8 & 0xFF00FF) * (256 - weight) + (to >> 8 & 0xFF00FF) * weight) & 0xFF00FF00);
+}
+
+// Where the centre of a pixel of the window falls between the centres of the frame's pixels, in 24.8 fixed point
+// (clamped to the frame, the last pixel getting no weight against the one after it):
+inline u32 getSourcePosition(u16 position, f32 scale, u16 source_size) {
+    f32 source_position = ((f32)position + 0.5f) * scale - 0.5f;
+    if (source_position <= 0) return 0;
+    if (source_position >= (f32)(source_size - 1)) return (u32)(source_size - 1) << 8;
+    return (u32)(source_position * 256);
+}
+
+// Bilinear, a band of the window's rows per job (with the window's frame buffer swapped back in):
+void upscaleRows(u32 job_id, u32 worker_id) {
+    FrameBuffer *source = &dynamic_resolution.frame_buffer;
+    u16 height = frame_buffer.dimentions.height,
+        width  = frame_buffer.dimentions.width,
+        first_y = (u16)(job_id * TILE_SIZE),
+        last_y = first_y + TILE_SIZE < height ? first_y + TILE_SIZE : height;
+    f32 y_scale = source->dimentions.f_height / frame_buffer.dimentions.f_height;
+    u32 *column, source_y, x_weight, y_weight, left, right;
+    Pixel *pixel, *pixel_row = frame_buffer.pixels + frame_buffer.stride * first_y, *top, *bottom;
+
+    for (u16 y = first_y; y < last_y; y++, pixel_row += frame_buffer.stride) {
+        source_y = getSourcePosition(y, y_scale, source->dimentions.height);
+        y_weight = source_y & 0xFF;
+        top = source->pixels + source->stride * (source_y >> 8);
+        bottom = y_weight ? top + source->stride : top;
+        pixel = pixel_row;
+        column = dynamic_resolution.columns;
+        for (u16 x = 0; x < width; x++, pixel++, column++) {
+            x_weight = *column & 0xFF;
+            left = *column >> 8;
+            right = left + (x_weight ? 1 : 0);
+            pixel->value = lerpPixels(lerpPixels(top[left].value,    top[right].value,    x_weight),
+                                      lerpPixels(bottom[left].value, bottom[right].value, x_weight), y_weight);
+        }
+    }
+}
+
+inline void upscaleFrame() {
+    dispatchJobs(&worker_pool, upscaleRows, (frame_buffer.dimentions.height + TILE_SIZE - 1) / TILE_SIZE);
+}
+
+// The screen-space bounds, the camera rays and the layout of the ray tracer's per-pixel buffers all follow the render
+// resolution, so the whole frame gets rendered anew (with the window's frame buffer swapped in):
+void setRenderScale(f32 scale) {
+    DynamicResolution *dr = &dynamic_resolution;
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        scaled_width  = (u16)((f32)width  * scale + 0.5f),
+        scaled_height = (u16)((f32)height * scale + 0.5f);
+    if (!scaled_width)  scaled_width  = 1;
+    if (!scaled_height) scaled_height = 1;
+
+    dr->scale = scale;
+    if (scale < 1) {
+        FrameBuffer *scaled = &dr->frame_buffer;
+        scaled->stride = (scaled_width + FRAME_BUFFER_ROW_ALIGNMENT - 1) / FRAME_BUFFER_ROW_ALIGNMENT * FRAME_BUFFER_ROW_ALIGNMENT;
+        scaled->size = scaled->stride * scaled_height;
+        f32 x_scale = (f32)scaled_width / (f32)width;
+        for (u16 x = 0; x < width; x++) dr->columns[x] = getSourcePosition(x, x_scale, scaled_width);
+
+        swapFrameBuffers();
+        updateFrameBufferDimensions(scaled_width, scaled_height);
+    } else
+        updateFrameBufferDimensions(width, height);
+
+    ray_tracer.ray_directions_changed = true;
+    ray_tracer.checkerboard.has_history = false;
+    invalidateFrame();
+    onMove(&main_scene);
+    if (dr->is_swapped) swapFrameBuffers();
+}
+
+// Picks the next frame's scale from the time the last ones took to render and upscale (see DynamicResolution):
+void updateRenderScale(u64 frame_ticks) {
+    DynamicResolution *dr = &dynamic_resolution;
+    u32 steps = (u32)(dr->scale * RENDER_SCALE_STEPS + 0.5f),
+        new_steps = RENDER_SCALE_STEPS;
+
+    // Accumulating is for quality, and restarts with every change of the scale:
+    if (dr->target_milliseconds && !accumulate) {
+        f32 milliseconds = (f32)((f64)frame_ticks * milliseconds_per_tick);
+        dr->average_milliseconds += dr->average_milliseconds ? RENDER_TIME_SMOOTHING * (milliseconds - dr->average_milliseconds) : milliseconds;
+
+        new_steps = steps;
+        bool is_slow = dr->average_milliseconds > dr->target_milliseconds,
+             is_fast = dr->average_milliseconds < dr->target_milliseconds * RENDER_SCALE_HEADROOM;
+        if (is_slow || is_fast) {
+            // Aiming for the middle of the range, as the time taken goes with the pixel count (the scale squared):
+            f32 aim = 0.5f * (1 + RENDER_SCALE_HEADROOM) * dr->target_milliseconds;
+            new_steps = (u32)((f32)steps * sqrtf(aim / dr->average_milliseconds) + 0.5f);
+            if (is_slow && new_steps >= steps) new_steps = steps - 1;
+            if (is_fast && new_steps <= steps) new_steps = steps + 1;
+            if (new_steps < MIN_RENDER_SCALE_STEPS) new_steps = MIN_RENDER_SCALE_STEPS;
+            if (new_steps > RENDER_SCALE_STEPS) new_steps = RENDER_SCALE_STEPS;
+        }
+    }
+    if (new_steps == steps) return;
+
+    f32 scale = (f32)new_steps / RENDER_SCALE_STEPS;
+    dr->average_milliseconds *= scale * scale / (dr->scale * dr->scale);
+    setRenderScale(scale);
+}
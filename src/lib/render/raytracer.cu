@@ -9,12 +9,15 @@
     vec3 ray_direction = d_vectors[1];    \
     vec3 right = d_vectors[2];            \
     vec3 down = d_vectors[3];\
+    vec3 ray_direction_rcp; \
     Ray ray;         \
     ray.origin = &ray_origin; \
     ray.direction = &ray_direction;   \
+    ray.direction_rcp = &ray_direction_rcp; \
     iscaleVec3(&right, x); iaddVec3(ray.direction, &right); \
     iscaleVec3(&down,  y); iaddVec3(ray.direction, &down); \
     norm3(ray.direction);                 \
+    reciprocalVec3(ray.direction, ray.direction_rcp); \
     ray.hit.distance = MAX_DISTANCE; \
                          \
     Scene scene;         \
@@ -26,7 +29,11 @@
     scene.cubes = d_cubes; \
     scene.ambient_light = d_ambient_light;\
     scene.cube_indices = d_cube_indices;\
-    scene.tetrahedron_indices = d_tetrahedron_indices
+    scene.tetrahedron_indices = d_tetrahedron_indices; \
+    scene.cube_count = CUBE_COUNT; \
+    scene.sphere_count = SPHERE_COUNT; \
+    scene.tetrahedron_count = TETRAHEDRON_COUNT; \
+    scene.mesh_count = 0
 
 __global__ void d_renderUVs() {     initShader(); renderUVs(     &ray, &scene, d_bvh_nodes, d_ssb_bounds, d_masks, x, y, pixel); }
 __global__ void d_renderDepth() {   initShader(); renderDepth(   &ray, &scene, d_bvh_nodes, d_ssb_bounds, d_masks, x, y, pixel); }
@@ -56,7 +63,11 @@ void renderOnGPU(vec3 *Ro, vec3 *start, vec3 *right, vec3 *down) {
         case Depth     : d_renderDepth<<<  blocks, threads>>>(); break;
         case Normals   : d_renderNormals<<<blocks, threads>>>(); break;
         case UVs       : d_renderUVs<<<    blocks, threads>>>(); break;
+        default        : break;
     }
     gpuErrchk( cudaPeekAtLastError() );
-    gpuErrchk(cudaMemcpyFromSymbol((u32*)frame_buffer.pixels, d_pixels, sizeof(u32) * frame_buffer.dimentions.width_times_height, 0, cudaMemcpyDeviceToHost));
+    // Into the padded rows of the frame buffer:
+    gpuErrchk(cudaMemcpy2D(frame_buffer.pixels, sizeof(Pixel) * frame_buffer.stride,
+                           d_pixels_address, sizeof(u32) * frame_buffer.dimentions.width,
+                           sizeof(u32) * frame_buffer.dimentions.width, frame_buffer.dimentions.height, cudaMemcpyDeviceToHost));
 }
\ No newline at end of file
@@ -1,57 +1,1026 @@
 #pragma once
 
+#include <stdio.h>
+#include <string.h>
+
 #include "lib/core/types.h"
+#include "lib/core/threads.h"
 #include "lib/globals/raytracing.h"
 #include "lib/shapes/line.h"
 #include "lib/shapes/bbox.h"
 #include "lib/shapes/helix.h"
+#include "lib/core/text.h"
 #include "lib/input/keyboard.h"
 #include "lib/controllers/fps.h"
 #include "lib/controllers/orb.h"
 #include "lib/controllers/camera_controller.h"
 #include "lib/nodes/camera.h"
 #include "lib/memory/allocators.h"
+#include "lib/memory/worker_allocators.h"
 
 #include "BVH.h"
 #include "SSB.h"
 #include "lib/render/shaders/shade.h"
+#include "lib/render/shaders/packet.h"
 
 #ifdef __CUDACC__
 #include "raytracer.cu"
 #endif
 
-#define runShaderOnCPU(shader) { \
-    for (u16 y = 0; y < frame_buffer.dimentions.height; y++) { \
-        for (u16 x = 0; x < frame_buffer.dimentions.width; x++, pixel++) { \
-            ray_direction = current; \
-            norm3(&ray_direction); \
-            shader(&ray, &main_scene, ray_tracer.bvh.nodes, &ray_tracer.ssb.bounds, &ray_tracer.masks, x, y, pixel); \
+#define runShaderOnTile(shader) { \
+    for (u16 y = first_y; y < last_y; y++, pixel_row += stride, Rd_row += stride, Rd_rcp_row += stride, hit_row += hit_row ? stride : 0) { \
+        pixel = pixel_row; \
+        hit = hit_row; \
+        Rd = Rd_row; \
+        Rd_rcp = Rd_rcp_row; \
+        for (u16 x = first_x; x < last_x; x += lane_count) { \
+            lane_count = last_x - x < PACKET_WIDTH ? (u8)(last_x - x) : PACKET_WIDTH; \
+            for (lane = 0; lane < lane_count; lane++) { \
+                rays[lane].direction = Rd++; \
+                rays[lane].direction_rcp = Rd_rcp++; \
+            } \
+            tracePrimaryPacket(rays, lane_count, &main_scene, &ray_tracer.ssb.bounds, &ray_tracer.masks, tile, x, y, 1); \
+            if (hit) for (lane = 0; lane < lane_count; lane++) *hit++ = rays[lane].hit; \
                                  \
-            iaddVec3(&current, right); \
+            for (lane = 0; lane < lane_count; lane++, pixel++) \
+                shader(rays + lane, &main_scene, ray_tracer.bvh.nodes, &ray_tracer.masks, pixel); \
         } \
-        iaddVec3(start, down); \
-        current = *start; \
     } \
 }
 
-void renderOnCPU(vec3 *Ro, vec3 *start, vec3 *right, vec3 *down) {
-    Pixel* pixel = frame_buffer.pixels;
-    vec3 ray_direction;
+// The start of each row is computed from the frame's start directly, so that tiles are independent:
+#define setTileRowOffset() \
+    scaleVec3(&tiles->right, (f32)first_x, &row_offset); \
+    iaddVec3(&row_offset, &tiles->start)
+
+void fillTileRayDirections(Tiles *tiles, u32 stride, u16 first_x, u16 first_y, u16 last_x, u16 last_y) {
+    u32 tile_start = stride * first_y + first_x;
+    vec3 *Rd, *Rd_row = ray_tracer.ray_directions + tile_start,
+         *Rd_rcp, *Rd_rcp_row = ray_tracer.ray_directions_rcp + tile_start,
+         current, row_offset;
+    setTileRowOffset();
+
+    for (u16 y = first_y; y < last_y; y++, Rd_row += stride, Rd_rcp_row += stride) {
+        scaleVec3(&tiles->down, (f32)y, &current);
+        iaddVec3(&current, &row_offset);
+        Rd = Rd_row;
+        Rd_rcp = Rd_rcp_row;
+        for (u16 x = first_x; x < last_x; x++, Rd++, Rd_rcp++) {
+            *Rd = current;
+            norm3(Rd);
+            reciprocalVec3(Rd, Rd_rcp);
+            iaddVec3(&current, &tiles->right);
+        }
+    }
+}
+
+// Adds the samples of the current frame to the tile's color sums (see Accumulation):
+#define runAccumulatingShaderOnTile(shader) { \
+    for (u8 sample = 0; sample < accumulation->new_sample_count; sample++) { \
+        color_sum_row = color_sums; \
+        for (u16 y = first_y; y < last_y; y++, color_sum_row += stride) { \
+            scaleVec3(&tiles->down, (f32)y, &current); \
+            iaddVec3(&current, &row_offset); \
+            iaddVec3(&current, accumulation->ray_direction_offsets + sample); \
+            color_sum = color_sum_row; \
+            for (u16 x = first_x; x < last_x; x += lane_count) { \
+                lane_count = last_x - x < PACKET_WIDTH ? (u8)(last_x - x) : PACKET_WIDTH; \
+                for (lane = 0; lane < lane_count; lane++) { \
+                    ray_directions[lane] = current; \
+                    norm3(ray_directions + lane); \
+                    reciprocalVec3(ray_directions + lane, ray_direction_rcps + lane); \
+                    iaddVec3(&current, &tiles->right); \
+                } \
+                tracePrimaryPacket(rays, lane_count, &main_scene, &ray_tracer.ssb.bounds, &ray_tracer.masks, tile, x, y, 1); \
+                                     \
+                for (lane = 0; lane < lane_count; lane++, color_sum++) { \
+                    shader(rays + lane, &main_scene, ray_tracer.bvh.nodes, &ray_tracer.masks, &color); \
+                    iaddVec3(color_sum, &color); \
+                } \
+            } \
+        } \
+    } \
+}
+
+void accumulateTileOnCPU(u32 tile_id, u32 worker_id) {
+    Tiles *tiles = &ray_tracer.tiles;
+    Accumulation *accumulation = &ray_tracer.accumulation;
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        first_x = (u16)(tile_id % tiles->columns) * TILE_SIZE,
+        first_y = (u16)(tile_id / tiles->columns) * TILE_SIZE,
+        last_x = first_x + TILE_SIZE < width  ? first_x + TILE_SIZE : width,
+        last_y = first_y + TILE_SIZE < height ? first_y + TILE_SIZE : height;
+
+    u32 stride = frame_buffer.stride,
+        tile_start = stride * first_y + first_x;
+    Pixel *pixel, *pixel_row = frame_buffer.pixels + tile_start;
+    vec3 *color_sum, *color_sum_row, *color_sums = accumulation->color_sums + tile_start;
+    TileGeometry tile_geometry, *tile = &tile_geometry;
+    ray_counts = ray_tracer.ray_stats.worker_counts + worker_id;
+    vec3 ray_directions[PACKET_WIDTH], ray_direction_rcps[PACKET_WIDTH], current, row_offset, color;
+    Ray rays[PACKET_WIDTH];
+    u8 lane, lane_count;
+    for (lane = 0; lane < PACKET_WIDTH; lane++) {
+        rays[lane].origin = &tiles->origin;
+        rays[lane].direction = ray_directions + lane;
+        rays[lane].direction_rcp = ray_direction_rcps + lane;
+    }
+
+    if (!accumulation->sample_count) {
+        color_sum_row = color_sums;
+        for (u16 y = first_y; y < last_y; y++, color_sum_row += stride)
+            memset(color_sum_row, 0, sizeof(vec3) * (last_x - first_x));
+    }
+
+    if (accumulation->new_sample_count) {
+        WorkerMemoryMarker worker_memory_marker = saveWorkerMemory();
+        allocateTileGeometry(tile, &main_scene);
+        gatherTileGeometry(tile, &main_scene, &ray_tracer.ssb.bounds, &ray_tracer.masks, first_x, first_y, last_x - 1, last_y - 1);
+
+        setTileRowOffset();
+
+        switch (render_mode) {
+            case Beauty    : runAccumulatingShaderOnTile(shadeBeautyColor)  break;
+            case Depth     : runAccumulatingShaderOnTile(shadeDepthColor)   break;
+            case Normals   : runAccumulatingShaderOnTile(shadeNormalsColor) break;
+            case UVs       : runAccumulatingShaderOnTile(shadeUVsColor)     break;
+            default        : break;
+        }
+        restoreWorkerMemory(worker_memory_marker);
+    }
+
+    // Show the averages:
+    f32 one_over_sample_count = 1.0f / (f32)(accumulation->sample_count + accumulation->new_sample_count);
+    color_sum_row = color_sums;
+    for (u16 y = first_y; y < last_y; y++, pixel_row += stride, color_sum_row += stride) {
+        pixel = pixel_row;
+        color_sum = color_sum_row;
+        for (u16 x = first_x; x < last_x; x++, pixel++, color_sum++) {
+            scaleVec3(color_sum, one_over_sample_count, &color);
+            setPixelColor(pixel, color);
+        }
+    }
+}
+
+void renderTileOnCPU(u32 tile_id, u32 worker_id) {
+    Tiles *tiles = &ray_tracer.tiles;
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        first_x = (u16)(tile_id % tiles->columns) * TILE_SIZE,
+        first_y = (u16)(tile_id / tiles->columns) * TILE_SIZE,
+        last_x = first_x + TILE_SIZE < width  ? first_x + TILE_SIZE : width,
+        last_y = first_y + TILE_SIZE < height ? first_y + TILE_SIZE : height;
+
+    u32 stride = frame_buffer.stride,
+        tile_start = stride * first_y + first_x;
+    Pixel *pixel, *pixel_row = frame_buffer.pixels + tile_start;
+    vec3 *Rd, *Rd_row = ray_tracer.ray_directions + tile_start,
+         *Rd_rcp, *Rd_rcp_row = ray_tracer.ray_directions_rcp + tile_start;
+    // Beauty frames that only render changes keep the G-buffer, for relighting:
+    RayHit *hit, *hit_row = render_mode == Beauty && render_changes_only ? ray_tracer.primary_hits + tile_start : 0;
+    TileGeometry tile_geometry, *tile = &tile_geometry;
+    ray_counts = ray_tracer.ray_stats.worker_counts + worker_id;
+    Ray rays[PACKET_WIDTH];
+    u8 lane, lane_count;
+    for (lane = 0; lane < PACKET_WIDTH; lane++) rays[lane].origin = &tiles->origin;
+
+    if (ray_tracer.ray_directions_changed) fillTileRayDirections(tiles, stride, first_x, first_y, last_x, last_y);
+
+    WorkerMemoryMarker worker_memory_marker = saveWorkerMemory();
+    allocateTileGeometry(tile, &main_scene);
+    gatherTileGeometry(tile, &main_scene, &ray_tracer.ssb.bounds, &ray_tracer.masks, first_x, first_y, last_x - 1, last_y - 1);
+
+    switch (render_mode) {
+        case Beauty    : runShaderOnTile(shadeBeautyPixel)  break;
+        case Depth     : runShaderOnTile(shadeDepthPixel)   break;
+        case Normals   : runShaderOnTile(shadeNormalsPixel) break;
+        case UVs       : runShaderOnTile(shadeUVsPixel)     break;
+        default        : break;
+    }
+    restoreWorkerMemory(worker_memory_marker);
+}
+
+// Cost mode:
+// =========
+// Pixels are traced one ray at a time (without packets) and shaded as in Beauty mode, counting their work (see RayCost).
+// Once all the counts are in, the selected counter is shown as a heatmap, relative to its highest count in the frame:
+void renderCostTileOnCPU(u32 tile_id, u32 worker_id) {
+    Tiles *tiles = &ray_tracer.tiles;
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        first_x = (u16)(tile_id % tiles->columns) * TILE_SIZE,
+        first_y = (u16)(tile_id / tiles->columns) * TILE_SIZE,
+        last_x = first_x + TILE_SIZE < width  ? first_x + TILE_SIZE : width,
+        last_y = first_y + TILE_SIZE < height ? first_y + TILE_SIZE : height;
+
+    u32 stride = frame_buffer.stride,
+        tile_start = stride * first_y + first_x;
+    vec3 *Rd, *Rd_row = ray_tracer.ray_directions + tile_start,
+         *Rd_rcp, *Rd_rcp_row = ray_tracer.ray_directions_rcp + tile_start,
+         color;
+    RayCost *cost, *cost_row = ray_tracer.cost_map.costs + tile_start,
+            *max_cost = ray_tracer.cost_map.worker_max_costs + worker_id;
+    Ray ray;
+    ray.origin = &tiles->origin;
+    ray_counts = ray_tracer.ray_stats.worker_counts + worker_id;
+
+    if (ray_tracer.ray_directions_changed) fillTileRayDirections(tiles, stride, first_x, first_y, last_x, last_y);
+
+    for (u16 y = first_y; y < last_y; y++, cost_row += stride, Rd_row += stride, Rd_rcp_row += stride) {
+        cost = cost_row;
+        Rd = Rd_row;
+        Rd_rcp = Rd_rcp_row;
+        for (u16 x = first_x; x < last_x; x++, cost++) {
+            memset(cost, 0, sizeof(RayCost));
+            ray_cost = cost;
+            ray.direction = Rd++;
+            ray.direction_rcp = Rd_rcp++;
+            tracePrimaryRay(&ray, &main_scene, &ray_tracer.ssb.bounds, &ray_tracer.masks, x, y);
+            shadeBeautyColor(&ray, &main_scene, ray_tracer.bvh.nodes, &ray_tracer.masks, &color);
+            ray_cost = 0;
+
+            for (u8 metric = 0; metric < COST_METRIC_COUNT; metric++)
+                max_cost->counts[metric] = max(max_cost->counts[metric], cost->counts[metric]);
+        }
+    }
+}
+
+void shadeCostTileOnCPU(u32 tile_id, u32 worker_id) {
+    Tiles *tiles = &ray_tracer.tiles;
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        first_x = (u16)(tile_id % tiles->columns) * TILE_SIZE,
+        first_y = (u16)(tile_id / tiles->columns) * TILE_SIZE,
+        last_x = first_x + TILE_SIZE < width  ? first_x + TILE_SIZE : width,
+        last_y = first_y + TILE_SIZE < height ? first_y + TILE_SIZE : height;
+
+    u32 stride = frame_buffer.stride,
+        tile_start = stride * first_y + first_x,
+        max_count = ray_tracer.cost_map.max_cost.counts[cost_metric];
+    f32 one_over_max_count = max_count ? 1.0f / (f32)max_count : 0;
+    Pixel *pixel, *pixel_row = frame_buffer.pixels + tile_start;
+    RayCost *cost, *cost_row = ray_tracer.cost_map.costs + tile_start;
+    vec3 color;
+
+    for (u16 y = first_y; y < last_y; y++, pixel_row += stride, cost_row += stride) {
+        pixel = pixel_row;
+        cost = cost_row;
+        for (u16 x = first_x; x < last_x; x++, pixel++, cost++) {
+            shadeHeat((f32)cost->counts[cost_metric] * one_over_max_count, &color);
+            setPixelColor(pixel, color);
+        }
+    }
+}
+
+void renderCostOnCPU() {
+    CostMap *cost_map = &ray_tracer.cost_map;
+    if (!cost_map->costs) cost_map->costs = AllocPixelsN(RayCost, ray_tracer.ray_count); // At the window's size
+    if (!cost_map->worker_max_costs) cost_map->worker_max_costs = AllocN(RayCost, worker_pool.worker_count);
+    memset(cost_map->worker_max_costs, 0, sizeof(RayCost) * worker_pool.worker_count);
+
+    dispatchJobs(&worker_pool, renderCostTileOnCPU, ray_tracer.tiles.count);
+
+    RayCost *max_cost = &cost_map->max_cost,
+            *worker_max_cost = cost_map->worker_max_costs;
+    *max_cost = *worker_max_cost;
+    for (u32 i = 1; i < worker_pool.worker_count; i++) {
+        worker_max_cost++;
+        for (u8 metric = 0; metric < COST_METRIC_COUNT; metric++)
+            max_cost->counts[metric] = max(max_cost->counts[metric], worker_max_cost->counts[metric]);
+    }
+
+    dispatchJobs(&worker_pool, shadeCostTileOnCPU, ray_tracer.tiles.count);
+}
+
+#define COST_LEGEND_WIDTH 256
+#define COST_LEGEND_HEIGHT 12
+
+static char* COST_METRIC_NAMES[COST_METRIC_COUNT] = {
+    "Intersection tests",
+    "BVH nodes visited",
+    "Shadow rays"
+};
+
+// A colour bar along the bottom-left corner, going from no work up to the frame's highest count:
+void drawCostLegend() {
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height;
+    if (width < HUD_LEFT + COST_LEGEND_WIDTH ||
+        height < HUD_TOP + COST_LEGEND_HEIGHT + LINE_HEIGHT) return;
+
+    i32 bottom = height - HUD_TOP,
+        top = bottom - COST_LEGEND_HEIGHT;
+    vec3 color;
+    Pixel pixel;
+    pixel.value = 0;
+    for (i32 x = 0; x < COST_LEGEND_WIDTH; x++) {
+        shadeHeat((f32)x / (COST_LEGEND_WIDTH - 1), &color);
+        setPixelColor((&pixel), color);
+        drawVLine2D(top, bottom, HUD_LEFT + x, pixel);
+    }
+
+    char text[64];
+    snprintf(text, sizeof(text), "%s: 0 - %u", COST_METRIC_NAMES[cost_metric], ray_tracer.cost_map.max_cost.counts[cost_metric]);
+    drawText(&frame_buffer, text, HUD_COLOR, HUD_LEFT, top - LINE_HEIGHT);
+}
+
+// Writes the counts of the last frame rendered in Cost mode as CSV, a row per pixel:
+bool writeCostMap(char *path) {
+    RayCost *cost, *cost_row = ray_tracer.cost_map.costs;
+    if (!cost_row) return false;
+
+    // At the resolution the frame was rendered at (see DynamicResolution):
+    FrameBuffer *rendered = dynamic_resolution.scale < 1 ? &dynamic_resolution.frame_buffer : &frame_buffer;
+
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+
+    fputs("x,y,intersection_tests,bvh_nodes_visited,shadow_rays\n", file);
+    for (u16 y = 0; y < rendered->dimentions.height; y++, cost_row += rendered->stride) {
+        cost = cost_row;
+        for (u16 x = 0; x < rendered->dimentions.width; x++, cost++)
+            fprintf(file, "%u,%u,%u,%u,%u\n", x, y,
+                    cost->counts[CostIntersectionTests], cost->counts[CostBVHNodesVisited], cost->counts[CostShadowRays]);
+    }
+
+    bool is_written = !ferror(file);
+    return !fclose(file) && is_written;
+}
+
+// Dirty regions:
+// =============
+// Geometry that changes while the camera is still invalidates the tiles its bounding sphere covers (callers invalidate
+// it before and after changes to its extent). In Beauty mode so do the tiles its shadows may fall on, and the ones
+// covered by geometry that reflects or refracts. Changes to the camera, lighting or render mode invalidate the frame:
+inline void invalidateFrame() {
+    ray_tracer.dirty_regions.is_full = true;
+}
+
+// Bounds are widened by a pixel, as they get rounded down:
+void invalidateTiles(Bounds2Di *bounds) {
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        columns = (width + TILE_SIZE - 1) / TILE_SIZE,
+        first_column = (bounds->x_range.min ? bounds->x_range.min - 1 : 0) / TILE_SIZE,
+        first_row    = (bounds->y_range.min ? bounds->y_range.min - 1 : 0) / TILE_SIZE,
+        last_column = (bounds->x_range.max + 1 < width  ? bounds->x_range.max + 1 : width  - 1) / TILE_SIZE,
+        last_row    = (bounds->y_range.max + 1 < height ? bounds->y_range.max + 1 : height - 1) / TILE_SIZE;
+    for (u16 row = first_row; row <= last_row; row++)
+        for (u16 column = first_column; column <= last_column; column++)
+            setBit(ray_tracer.dirty_regions.tiles, (u32)row * columns + column);
+}
+
+// Of extents in normalized device coordinates (see projectSphere):
+void invalidateProjection(f32 left, f32 right, f32 bottom, f32 top) {
+    if (!isOnScreen(left, right, bottom, top)) return;
+
+    Bounds2Di bounds;
+    setScreenBounds(&bounds, left, right, bottom, top);
+    invalidateTiles(&bounds);
+}
+
+// Of a sphere in view space. Returns false when the sphere reaches behind the camera (its projection is unbounded):
+bool invalidateSphere(vec3 *P, f32 radius, f32 focal_length) {
+    if (P->z <= radius) return P->z <= -radius;
+
+    f32 left, right, bottom, top;
+    projectSphere(P->x, P->y, P->z, radius, focal_length, &left, &right, &bottom, &top);
+    invalidateProjection(left, right, bottom, top);
+    return true;
+}
+
+// Keeps the part of a convex polygon on the given side of the line through the apex along the edge:
+u8 clipPolygon(vec2 *polygon, u8 count, vec2 *apex, vec2 *edge, f32 side, vec2 *clipped) {
+    u8 clipped_count = 0;
+    vec2 *from, *to = polygon + count - 1;
+    f32 from_distance, to_distance = side * (edge->x * (to->y - apex->y) - edge->y * (to->x - apex->x));
+    for (u8 i = 0; i < count; i++) {
+        from = to;
+        from_distance = to_distance;
+        to = polygon + i;
+        to_distance = side * (edge->x * (to->y - apex->y) - edge->y * (to->x - apex->x));
+        if ((from_distance < 0) != (to_distance < 0)) {
+            f32 t = from_distance / (from_distance - to_distance);
+            clipped[clipped_count].x = from->x + t * (to->x - from->x);
+            clipped[clipped_count].y = from->y + t * (to->y - from->y);
+            clipped_count++;
+        }
+        if (to_distance >= 0) clipped[clipped_count++] = *to;
+    }
+
+    return clipped_count;
+}
+
+// The shadows a sphere (in view space) casts from a light (in view space) fall within a cone from the light.
+// When the cone heads away from the camera: Up to the sphere's centre it is within a sphere around it (of the cone's
+// radius there plus the sphere's), and beyond it the cone's projection reaches out to where its far end projects to,
+// the projection of a sphere around the cone's direction (at a distance of 1) with the sine of its half-angle as radius.
+// Otherwise, with the light in front of the camera: Rays from the light project to rays from the light's projection,
+// so the cone projects within a wedge from there, bounded by the projections of the two planes that go through the
+// camera and the light and are tangent to the sphere (that must not be in the way between the camera and the light).
+// Returns false when neither bounds the shadows:
+bool invalidateShadow(vec3 *P, f32 radius, vec3 *L, f32 focal_length) {
+    vec3 direction;
+    subVec3(P, L, &direction);
+    f32 distance = lengthVec3(&direction);
+    if (distance <= radius) return false;
+
+    f32 left, right, bottom, top,
+        sine = radius / distance,
+        near_radius = radius / sqrtf(1 - sine*sine) + radius;
+    iscaleVec3(&direction, 1 / distance);
+    if (P->z > near_radius && direction.z > sine) {
+        f32 far_left, far_right, far_bottom, far_top;
+        projectSphere(P->x, P->y, P->z, near_radius, focal_length, &left, &right, &bottom, &top);
+        projectSphere(direction.x, direction.y, direction.z, sine, focal_length, &far_left, &far_right, &far_bottom, &far_top);
+        invalidateProjection(min(left, far_left), max(right, far_right), min(bottom, far_bottom), max(top, far_top));
+        return true;
+    }
+
+    distance = lengthVec3(L);
+    if (L->z <= EPS * distance) return false;
+
+    // The planes contain the line through the camera and the light (along u), e1 points away from it to the sphere:
+    vec3 u, e1, e2, w;
+    scaleVec3(L, 1 / distance, &u);
+    scaleVec3(&u, dotVec3(P, &u), &e1);
+    subVec3(P, &e1, &e1);
+    distance = lengthVec3(&e1);
+    if (distance <= radius) return false;
+
+    iscaleVec3(&e1, 1 / distance);
+    crossVec3(&u, &e1, &e2);
+    sine = radius / distance;
+    f32 cosine = sqrtf(1 - sine*sine),
+        y_factor = focal_length * frame_buffer.dimentions.width_over_height;
+
+    vec2 apex, edges[2];
+    apex.x = focal_length * L->x / L->z;
+    apex.y = y_factor     * L->y / L->z;
+    for (u8 i = 0; i < 2; i++) {
+        w.x = cosine * e1.x + (i ? -sine : sine) * e2.x;
+        w.y = cosine * e1.y + (i ? -sine : sine) * e2.y;
+        w.z = cosine * e1.z + (i ? -sine : sine) * e2.z;
+        edges[i].x = focal_length * (w.x * L->z - L->x * w.z);
+        edges[i].y = y_factor     * (w.y * L->z - L->y * w.z);
+    }
+    f32 turn = edges[0].x * edges[1].y - edges[0].y * edges[1].x;
+    if (turn * turn <= EPS * squaredLengthVec2(edges) * squaredLengthVec2(edges + 1)) return false;
+
+    vec2 screen[4], clipped[5], polygon[6];
+    screen[0].x = screen[3].x = screen[0].y = screen[1].y = -1;
+    screen[1].x = screen[2].x = screen[2].y = screen[3].y = 1;
+    u8 count = clipPolygon(screen,  4,     &apex, edges,     turn > 0 ? 1.0f : -1.0f, clipped);
+    count    = clipPolygon(clipped, count, &apex, edges + 1, turn > 0 ? -1.0f : 1.0f, polygon);
+    if (!count) return true;
+
+    left = right = polygon->x;
+    bottom = top = polygon->y;
+    for (u8 i = 1; i < count; i++) {
+        left   = min(left,   polygon[i].x);
+        right  = max(right,  polygon[i].x);
+        bottom = min(bottom, polygon[i].y);
+        top    = max(top,    polygon[i].y);
+    }
+    invalidateProjection(left, right, bottom, top);
+    return true;
+}
+
+inline void getViewPosition(vec3 *position, vec3 *view_position) {
+    subVec3(position, &current_camera_controller->camera->transform.position, view_position);
+    imulVec3Mat3(view_position, &current_camera_controller->camera->transform.rotation_matrix_inverted);
+}
+
+inline NodePtr* getGeometryNodes(Scene *scene, u8 geo_type, u16 *geo_count) {
+    switch (geo_type) {
+        case GeoTypeCube       : *geo_count = scene->cube_count;        return scene->node_ptrs.cubes;
+        case GeoTypeSphere     : *geo_count = scene->sphere_count;      return scene->node_ptrs.spheres;
+        case GeoTypeTetrahedron: *geo_count = scene->tetrahedron_count; return scene->node_ptrs.tetrahedra;
+        default                : *geo_count = scene->mesh_count;        return scene->node_ptrs.meshes;
+    }
+}
+
+inline u64* getGeometryMask(GeometryMasks *masks, u8 geo_type) {
+    switch (geo_type) {
+        case GeoTypeCube       : return masks->cubes;
+        case GeoTypeSphere     : return masks->spheres;
+        case GeoTypeTetrahedron: return masks->tetrahedra;
+        default                : return masks->meshes;
+    }
+}
+
+void invalidateGeometry(Scene *scene, u8 geo_type, u16 geo_id) {
+    frame_changes |= SCENE_CHANGED;
+    if (ray_tracer.dirty_regions.is_full) return;
+
+    // Reprojection looks the tiles up in the last frame's view, which the camera already moved away from:
+    if (ray_tracer.reprojection.is_moving) {
+        invalidateFrame();
+        return;
+    }
+
+    u16 geo_count;
+    Node *node = getGeometryNodes(scene, geo_type, &geo_count)[geo_id];
+    f32 focal_length = current_camera_controller->camera->focal_length;
+    vec3 P, L;
+    getViewPosition(&node->position, &P);
+    bool is_bounded = invalidateSphere(&P, node->radius, focal_length);
+
+    // Only the Beauty mode traces shadow rays. No mode traces secondary rays (shadeSurface does not), so the reflections
+    // and refractions of the geometry need not be invalidated:
+    if (is_bounded && render_mode == Beauty && testBit(getGeometryMask(&ray_tracer.masks.shadowing, geo_type), geo_id))
+        for (u8 i = 0; i < POINT_LIGHT_COUNT && is_bounded; i++) {
+            getViewPosition(&scene->point_lights[i].position, &L);
+            is_bounded = invalidateShadow(&P, node->radius, &L, focal_length);
+        }
+
+    if (!is_bounded) invalidateFrame();
+}
+
+// Edits of the lights leave the primary hits as they were, so they only get shaded again:
+inline void invalidateLighting() {
+    frame_changes |= SCENE_CHANGED;
+    ray_tracer.dirty_regions.is_relit = true;
+}
+
+// Shades the tile's primary hits from the G-buffer (as the Beauty mode does):
+void relightTileOnCPU(u32 tile_id, u32 worker_id) {
+    Tiles *tiles = &ray_tracer.tiles;
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        first_x = (u16)(tile_id % tiles->columns) * TILE_SIZE,
+        first_y = (u16)(tile_id / tiles->columns) * TILE_SIZE,
+        last_x = first_x + TILE_SIZE < width  ? first_x + TILE_SIZE : width,
+        last_y = first_y + TILE_SIZE < height ? first_y + TILE_SIZE : height;
+
+    u32 stride = frame_buffer.stride,
+        tile_start = stride * first_y + first_x;
+    Pixel *pixel, *pixel_row = frame_buffer.pixels + tile_start;
+    vec3 *Rd, *Rd_row = ray_tracer.ray_directions + tile_start,
+         *Rd_rcp, *Rd_rcp_row = ray_tracer.ray_directions_rcp + tile_start;
+    RayHit *hit, *hit_row = ray_tracer.primary_hits + tile_start;
+    ray_counts = ray_tracer.ray_stats.worker_counts + worker_id;
     Ray ray;
-    ray.origin = Ro;
-    ray.direction = &ray_direction;
+    ray.origin = &tiles->origin;
+
+    for (u16 y = first_y; y < last_y; y++, pixel_row += stride, Rd_row += stride, Rd_rcp_row += stride, hit_row += stride) {
+        pixel = pixel_row;
+        Rd = Rd_row;
+        Rd_rcp = Rd_rcp_row;
+        hit = hit_row;
+        for (u16 x = first_x; x < last_x; x++, pixel++, hit++) {
+            ray.direction = Rd++;
+            ray.direction_rcp = Rd_rcp++;
+            ray.hit = *hit;
+            shadeBeautyPixel(&ray, &main_scene, ray_tracer.bvh.nodes, &ray_tracer.masks, pixel);
+        }
+    }
+}
+
+// Whether both hits are on the same surface: of the same material, facing the same way and on the same plane (relative
+// to the first hit's distance from the camera at Ro), or both missed everything:
+bool isSameSurface(RayHit *hit, RayHit *other_hit, vec3 *Ro) {
+    if (hit->distance == MAX_DISTANCE || other_hit->distance == MAX_DISTANCE) return hit->distance == other_hit->distance;
+    if (other_hit->material_id != hit->material_id ||
+        dotVec3(&other_hit->normal, &hit->normal) < REPROJECTION_NORMAL_TOLERANCE) return false;
+
+    vec3 offset, P;
+    subVec3(&other_hit->position, &hit->position, &offset);
+    subVec3(&hit->position, Ro, &P);
+    f32 depth_offset = dotVec3(&offset, &hit->normal);
+    return depth_offset * depth_offset <= REPROJECTION_DEPTH_TOLERANCE * REPROJECTION_DEPTH_TOLERANCE * squaredLengthVec3(&P);
+}
+
+// Finds the pixel the last frame saw the hit at, returning false when it saw another surface there (or a changed one).
+// Only Lambert shading looks the same from anywhere, the rest (specular highlights included) depends on the ray's
+// direction, so hits of any other material are always shaded again:
+bool reprojectHit(RayHit *hit, vec3 *Ro, u32 *last_pixel_id) {
+    Reprojection *reprojection = &ray_tracer.reprojection;
+    if (hit->distance == MAX_DISTANCE || main_scene.materials[hit->material_id].uses & (u8)~LAMBERT) return false;
+
+    vec3 P;
+    subVec3(&hit->position, &reprojection->position, &P);
+    imulVec3Mat3(&P, &reprojection->rotation_inverted);
+    if (P.z <= EPS) return false;
+
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height;
+    f32 factor = reprojection->focal_length * (f32)width / P.z,
+        x = 0.5f * (P.x * factor + (f32)width - 1),
+        y = 0.5f * ((f32)height - 2 - P.y * factor);
+    if (x <= -0.5f || y <= -0.5f || x >= (f32)width - 0.5f || y >= (f32)height - 0.5f) return false;
+
+    u16 last_x = (u16)(x + 0.5f),
+        last_y = (u16)(y + 0.5f);
+    if (testBit(ray_tracer.dirty_regions.tiles, (u32)(last_y / TILE_SIZE) * ray_tracer.tiles.columns + last_x / TILE_SIZE))
+        return false;
+
+    *last_pixel_id = frame_buffer.stride * last_y + last_x;
+    return isSameSurface(hit, reprojection->last_hits + *last_pixel_id, Ro);
+}
+
+// Traces the tile's primary rays, carrying the colors of the surfaces the last frame saw over from it (see Reprojection)
+// and shading the rest:
+void reprojectTileOnCPU(u32 tile_id, u32 worker_id) {
+    Tiles *tiles = &ray_tracer.tiles;
+    Reprojection *reprojection = &ray_tracer.reprojection;
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        first_x = (u16)(tile_id % tiles->columns) * TILE_SIZE,
+        first_y = (u16)(tile_id / tiles->columns) * TILE_SIZE,
+        last_x = first_x + TILE_SIZE < width  ? first_x + TILE_SIZE : width,
+        last_y = first_y + TILE_SIZE < height ? first_y + TILE_SIZE : height;
+
+    u32 stride = frame_buffer.stride,
+        tile_start = stride * first_y + first_x,
+        last_pixel_id,
+        reused_count = 0;
+    Pixel *pixel, *pixel_row = frame_buffer.pixels + tile_start;
+    vec3 *Rd, *Rd_row = ray_tracer.ray_directions + tile_start,
+         *Rd_rcp, *Rd_rcp_row = ray_tracer.ray_directions_rcp + tile_start;
+    RayHit *hit, *hit_row = ray_tracer.primary_hits + tile_start;
+    u8 *age, *age_row = reprojection->ages + tile_start, last_age;
+    TileGeometry tile_geometry, *tile = &tile_geometry;
+    ray_counts = ray_tracer.ray_stats.worker_counts + worker_id;
+    Ray rays[PACKET_WIDTH], *ray;
+    u8 lane, lane_count;
+    for (lane = 0; lane < PACKET_WIDTH; lane++) rays[lane].origin = &tiles->origin;
+
+    if (ray_tracer.ray_directions_changed) fillTileRayDirections(tiles, stride, first_x, first_y, last_x, last_y);
+
+    WorkerMemoryMarker worker_memory_marker = saveWorkerMemory();
+    allocateTileGeometry(tile, &main_scene);
+    gatherTileGeometry(tile, &main_scene, &ray_tracer.ssb.bounds, &ray_tracer.masks, first_x, first_y, last_x - 1, last_y - 1);
+
+    for (u16 y = first_y; y < last_y; y++, pixel_row += stride, Rd_row += stride, Rd_rcp_row += stride, hit_row += stride, age_row += stride) {
+        pixel = pixel_row;
+        Rd = Rd_row;
+        Rd_rcp = Rd_rcp_row;
+        hit = hit_row;
+        age = age_row;
+        for (u16 x = first_x; x < last_x; x += lane_count) {
+            lane_count = last_x - x < PACKET_WIDTH ? (u8)(last_x - x) : PACKET_WIDTH;
+            for (lane = 0; lane < lane_count; lane++) {
+                rays[lane].direction = Rd++;
+                rays[lane].direction_rcp = Rd_rcp++;
+            }
+            tracePrimaryPacket(rays, lane_count, &main_scene, &ray_tracer.ssb.bounds, &ray_tracer.masks, tile, x, y, 1);
+
+            for (lane = 0, ray = rays; lane < lane_count; lane++, ray++, pixel++, hit++, age++) {
+                *hit = ray->hit;
+                last_age = REPROJECTION_MAX_AGE;
+                if (reprojectHit(hit, &tiles->origin, &last_pixel_id))
+                    last_age = reprojection->is_chained ? reprojection->last_ages[last_pixel_id] : getReprojectionPhase(x + lane, y);
+
+                if (last_age < REPROJECTION_MAX_AGE) {
+                    *pixel = reprojection->last_image[last_pixel_id];
+                    *age = last_age + 1;
+                    reused_count++;
+                } else {
+                    shadeBeautyPixel(ray, &main_scene, ray_tracer.bvh.nodes, &ray_tracer.masks, pixel);
+                    *age = getReprojectionPhase(x + lane, y);
+                }
+            }
+        }
+    }
+    restoreWorkerMemory(worker_memory_marker);
+    if (reused_count) atomicAdd(&reprojection->reused_count, reused_count);
+}
+
+// Traces the tile when it was invalidated (or shades it again when relit) and keeps its image for the frames to come,
+// or copies it from there:
+void updateTileOnCPU(u32 tile_id, u32 worker_id) {
+    DirtyRegions *dirty_regions = &ray_tracer.dirty_regions;
+    Tiles *tiles = &ray_tracer.tiles;
+    bool is_reprojected = ray_tracer.reprojection.is_reprojecting,
+         is_dirty = is_reprojected || dirty_regions->is_full || testBit(dirty_regions->tiles, tile_id);
+    if (is_reprojected) reprojectTileOnCPU(tile_id, worker_id);
+    else if (is_dirty) renderTileOnCPU(tile_id, worker_id);
+    else if (dirty_regions->is_relit) relightTileOnCPU(tile_id, worker_id);
+    is_dirty |= dirty_regions->is_relit;
+
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        first_x = (u16)(tile_id % tiles->columns) * TILE_SIZE,
+        first_y = (u16)(tile_id / tiles->columns) * TILE_SIZE,
+        last_x = first_x + TILE_SIZE < width  ? first_x + TILE_SIZE : width,
+        last_y = first_y + TILE_SIZE < height ? first_y + TILE_SIZE : height;
 
-    vec3 current = *start;
+    u32 stride = frame_buffer.stride,
+        tile_start = stride * first_y + first_x;
+    Pixel *pixel_row = frame_buffer.pixels + tile_start,
+          *image_row = dirty_regions->image + tile_start;
+    for (u16 y = first_y; y < last_y; y++, pixel_row += stride, image_row += stride)
+        memcpy(is_dirty ? image_row : pixel_row, is_dirty ? pixel_row : image_row, sizeof(Pixel) * (last_x - first_x));
+}
+
+void renderChangesOnCPU() {
+    DirtyRegions *dirty_regions = &ray_tracer.dirty_regions;
+    Reprojection *reprojection = &ray_tracer.reprojection;
+    Tiles *tiles = &ray_tracer.tiles;
+    if (dirty_regions->render_mode != render_mode) {
+        dirty_regions->render_mode = render_mode;
+        dirty_regions->is_full = true;
+    }
+
+    // Lighting only shows in Beauty mode:
+    if (render_mode != Beauty) dirty_regions->is_relit = false;
+
+    // Moving the camera reprojects the last frame unless all of it changed, otherwise the whole frame gets traced,
+    // as it does once the camera stops after moving (replacing the reused colors):
+    bool is_reprojected = reprojection->is_moving && reproject_shading && render_mode == Beauty &&
+                          !dirty_regions->is_full && !dirty_regions->is_relit;
+    if (reprojection->is_moving ? !is_reprojected : reprojection->is_chained) dirty_regions->is_full = true;
+
+    dirty_regions->tile_count = 0;
+    if (dirty_regions->is_full || is_reprojected) dirty_regions->tile_count = tiles->count;
+    else for (u32 i = 0; i < tiles->count; i++) if (testBit(dirty_regions->tiles, i)) dirty_regions->tile_count++;
+
+    // The last frame's buffers are read while the current frame's get written:
+    reprojection->reused_count = 0;
+    reprojection->is_reprojecting = is_reprojected;
+    if (is_reprojected) {
+        RayHit *hits = ray_tracer.primary_hits;
+        ray_tracer.primary_hits = reprojection->last_hits;
+        reprojection->last_hits = hits;
+
+        Pixel *image = dirty_regions->image;
+        dirty_regions->image = reprojection->last_image;
+        reprojection->last_image = image;
+
+        u8 *ages = reprojection->ages;
+        reprojection->ages = reprojection->last_ages;
+        reprojection->last_ages = ages;
+    }
+
+    dispatchJobs(&worker_pool, updateTileOnCPU, tiles->count);
+    clearBitset(dirty_regions->tiles, dirty_regions->tile_bit_count);
+    dirty_regions->is_full = dirty_regions->is_relit = false;
+    reprojection->is_chained = is_reprojected;
+    reprojection->is_reprojecting = false;
+
+    Camera *camera = current_camera_controller->camera;
+    reprojection->rotation_inverted = camera->transform.rotation_matrix_inverted;
+    reprojection->position = camera->transform.position;
+    reprojection->focal_length = camera->focal_length;
+}
+
+// Checkerboard rendering:
+// ======================
+// Traces the current frame's half of the tile (see Checkerboard), keeping its pixels in the image and the G-buffer:
+#define runCheckerboardShaderOnTile(shader) { \
+    for (u16 y = first_y; y < last_y; y++, pixel_row += stride, image_row += stride, Rd_row += stride, Rd_rcp_row += stride, hit_row += stride) { \
+        for (u16 x = first_x + ((first_x + y + checkerboard->phase) & 1); x < last_x; x += 2 * lane_count) { \
+            lane_count = (last_x - x + 1) / 2 < PACKET_WIDTH ? (u8)((last_x - x + 1) / 2) : PACKET_WIDTH; \
+            for (lane = 0, i = x - first_x; lane < lane_count; lane++, i += 2) { \
+                rays[lane].direction = Rd_row + i; \
+                rays[lane].direction_rcp = Rd_rcp_row + i; \
+            } \
+            tracePrimaryPacket(rays, lane_count, &main_scene, &ray_tracer.ssb.bounds, &ray_tracer.masks, tile, x, y, 2); \
+                                 \
+            for (lane = 0, i = x - first_x; lane < lane_count; lane++, i += 2) { \
+                hit_row[i] = rays[lane].hit; \
+                shader(rays + lane, &main_scene, ray_tracer.bvh.nodes, &ray_tracer.masks, pixel_row + i); \
+                image_row[i] = pixel_row[i]; \
+            } \
+        } \
+    } \
+}
+
+void traceCheckerboardTileOnCPU(u32 tile_id, u32 worker_id) {
+    Tiles *tiles = &ray_tracer.tiles;
+    Checkerboard *checkerboard = &ray_tracer.checkerboard;
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        first_x = (u16)(tile_id % tiles->columns) * TILE_SIZE,
+        first_y = (u16)(tile_id / tiles->columns) * TILE_SIZE,
+        last_x = first_x + TILE_SIZE < width  ? first_x + TILE_SIZE : width,
+        last_y = first_y + TILE_SIZE < height ? first_y + TILE_SIZE : height,
+        i;
+
+    u32 stride = frame_buffer.stride,
+        tile_start = stride * first_y + first_x;
+    Pixel *pixel_row = frame_buffer.pixels + tile_start,
+          *image_row = ray_tracer.dirty_regions.image + tile_start;
+    vec3 *Rd_row = ray_tracer.ray_directions + tile_start,
+         *Rd_rcp_row = ray_tracer.ray_directions_rcp + tile_start;
+    RayHit *hit_row = ray_tracer.primary_hits + tile_start;
+    TileGeometry tile_geometry, *tile = &tile_geometry;
+    ray_counts = ray_tracer.ray_stats.worker_counts + worker_id;
+    Ray rays[PACKET_WIDTH];
+    u8 lane, lane_count;
+    for (lane = 0; lane < PACKET_WIDTH; lane++) rays[lane].origin = &tiles->origin;
+
+    if (ray_tracer.ray_directions_changed) fillTileRayDirections(tiles, stride, first_x, first_y, last_x, last_y);
+
+    WorkerMemoryMarker worker_memory_marker = saveWorkerMemory();
+    allocateTileGeometry(tile, &main_scene);
+    gatherTileGeometry(tile, &main_scene, &ray_tracer.ssb.bounds, &ray_tracer.masks, first_x, first_y, last_x - 1, last_y - 1);
 
     switch (render_mode) {
-        case Beauty    : runShaderOnCPU(renderBeauty)  break;
-        case Depth     : runShaderOnCPU(renderDepth)   break;
-        case Normals   : runShaderOnCPU(renderNormals) break;
-        case UVs       : runShaderOnCPU(renderUVs)     break;
+        case Beauty    : runCheckerboardShaderOnTile(shadeBeautyPixel)  break;
+        case Depth     : runCheckerboardShaderOnTile(shadeDepthPixel)   break;
+        case Normals   : runCheckerboardShaderOnTile(shadeNormalsPixel) break;
+        case UVs       : runCheckerboardShaderOnTile(shadeUVsPixel)     break;
+        default        : break;
+    }
+    restoreWorkerMemory(worker_memory_marker);
+}
+
+// Fills in the other half of the tile, once the current frame's half of every tile got traced (see Checkerboard):
+void reconstructCheckerboardTileOnCPU(u32 tile_id, u32 worker_id) {
+    Tiles *tiles = &ray_tracer.tiles;
+    Checkerboard *checkerboard = &ray_tracer.checkerboard;
+    DirtyRegions *dirty_regions = &ray_tracer.dirty_regions;
+    u16 width  = frame_buffer.dimentions.width,
+        height = frame_buffer.dimentions.height,
+        first_x = (u16)(tile_id % tiles->columns) * TILE_SIZE,
+        first_y = (u16)(tile_id / tiles->columns) * TILE_SIZE,
+        last_x = first_x + TILE_SIZE < width  ? first_x + TILE_SIZE : width,
+        last_y = first_y + TILE_SIZE < height ? first_y + TILE_SIZE : height;
+
+    u32 stride = frame_buffer.stride,
+        pixel_id,
+        neighbour_ids[4],
+        red, green, blue;
+    Pixel *pixels = frame_buffer.pixels, *neighbour;
+    RayHit *hits = ray_tracer.primary_hits;
+    vec3 *Ro = &tiles->origin;
+    bool is_copied = checkerboard->is_history_valid && !testBit(dirty_regions->tiles, tile_id),
+         has_neighbour[4];
+    u8 i, neighbours, count;
+
+    for (u16 y = first_y; y < last_y; y++) {
+        for (u16 x = first_x + ((first_x + y + checkerboard->phase + 1) & 1); x < last_x; x += 2) {
+            pixel_id = stride * y + x;
+            if (is_copied) {
+                pixels[pixel_id] = dirty_regions->image[pixel_id];
+                continue;
+            }
+
+            // Left, right, up and down (all traced by the current frame):
+            neighbour_ids[0] = pixel_id - 1;      has_neighbour[0] = x > 0;
+            neighbour_ids[1] = pixel_id + 1;      has_neighbour[1] = x + 1 < width;
+            neighbour_ids[2] = pixel_id - stride; has_neighbour[2] = y > 0;
+            neighbour_ids[3] = pixel_id + stride; has_neighbour[3] = y + 1 < height;
+
+            // A bit per neighbour to average, matching the last frame's hit when there is one:
+            neighbours = 0;
+            if (checkerboard->has_history)
+                for (i = 0; i < 4; i++)
+                    if (has_neighbour[i] && isSameSurface(hits + pixel_id, hits + neighbour_ids[i], Ro)) neighbours |= 1 << i;
+            if (!neighbours) {
+                if (has_neighbour[0] && has_neighbour[1] && isSameSurface(hits + neighbour_ids[0], hits + neighbour_ids[1], Ro)) neighbours |= 3;
+                if (has_neighbour[2] && has_neighbour[3] && isSameSurface(hits + neighbour_ids[2], hits + neighbour_ids[3], Ro)) neighbours |= 12;
+                if (!neighbours) for (i = 0; i < 4; i++) if (has_neighbour[i]) neighbours |= 1 << i;
+            }
+
+            red = green = blue = count = 0;
+            for (i = 0; i < 4; i++)
+                if (neighbours & (1 << i)) {
+                    neighbour = pixels + neighbour_ids[i];
+                    red   += neighbour->color.R;
+                    green += neighbour->color.G;
+                    blue  += neighbour->color.B;
+                    count++;
+                }
+            if (count) {
+                pixels[pixel_id].color.R = (u8)(red   / count);
+                pixels[pixel_id].color.G = (u8)(green / count);
+                pixels[pixel_id].color.B = (u8)(blue  / count);
+            }
+        }
+    }
+}
+
+// The frame gets traced before it gets reconstructed, as reconstructing reads the neighbouring tiles:
+void renderCheckerboardOnCPU() {
+    Checkerboard *checkerboard = &ray_tracer.checkerboard;
+    DirtyRegions *dirty_regions = &ray_tracer.dirty_regions;
+    Tiles *tiles = &ray_tracer.tiles;
+    if (dirty_regions->render_mode != render_mode) {
+        dirty_regions->render_mode = render_mode;
+        dirty_regions->is_full = true;
+    }
+
+    checkerboard->is_history_valid = checkerboard->has_history && !ray_tracer.reprojection.is_moving &&
+                                     !dirty_regions->is_full && !dirty_regions->is_relit;
+    checkerboard->is_complete = checkerboard->is_history_valid;
+    for (u32 i = 0; i < tiles->count && checkerboard->is_complete; i++)
+        if (testBit(dirty_regions->tiles, i)) checkerboard->is_complete = false;
+    checkerboard->phase ^= 1;
+
+    dispatchJobs(&worker_pool, traceCheckerboardTileOnCPU, tiles->count);
+    dispatchJobs(&worker_pool, reconstructCheckerboardTileOnCPU, tiles->count);
+    clearBitset(dirty_regions->tiles, dirty_regions->tile_bit_count);
+    dirty_regions->is_full = dirty_regions->is_relit = false;
+    dirty_regions->tile_count = tiles->count;
+    checkerboard->has_history = true;
+}
+
+// Any change to what a pixel would show has to restart the accumulation (see Accumulation):
+void restartAccumulation() {
+    ray_tracer.accumulation.sample_count = 0;
+}
+
+// The samples' offsets from the pixel's centre (within half a pixel) follow a Halton sequence in bases 2 and 3,
+// shifted by half a pixel so that the first sample is at the centre (matching a frame that is not accumulated):
+f32 getSubpixelOffset(u32 sample, u32 base) {
+    f32 offset = 0.5f, fraction = 1;
+    for (; sample; sample /= base) {
+        fraction /= (f32)base;
+        offset += fraction * (f32)(sample % base);
+    }
+    return (offset < 1 ? offset : offset - 1) - 0.5f;
+}
+
+void renderOnCPU(vec3 *Ro, vec3 *start, vec3 *right, vec3 *down) {
+    Tiles *tiles = &ray_tracer.tiles;
+    tiles->origin = *Ro;
+    tiles->start  = *start;
+    tiles->right  = *right;
+    tiles->down   = *down;
+    tiles->columns = (frame_buffer.dimentions.width  + TILE_SIZE - 1) / TILE_SIZE;
+    tiles->rows    = (frame_buffer.dimentions.height + TILE_SIZE - 1) / TILE_SIZE;
+    tiles->count   = (u32)tiles->columns * tiles->rows;
+
+    // Checkerboarded frames only keep half of the image and G-buffer of the dirty regions up to date:
+    Checkerboard *checkerboard = &ray_tracer.checkerboard;
+    bool is_checkerboarded = checkerboard_rendering && !accumulate && render_mode != Cost;
+    if (!is_checkerboarded) {
+        if (checkerboard->has_history) invalidateFrame();
+        checkerboard->has_history = false;
+        checkerboard->is_complete = true;
+    }
+
+    if (!accumulate || render_mode == Cost) {
+        if (is_checkerboarded) renderCheckerboardOnCPU();
+        else if (render_mode != Cost && render_changes_only) renderChangesOnCPU();
+        else {
+            if (render_mode == Cost) renderCostOnCPU();
+            else dispatchJobs(&worker_pool, renderTileOnCPU, tiles->count);
+            invalidateFrame();
+        }
+        ray_tracer.ray_directions_changed = false;
+        restartAccumulation();
+        return;
+    }
+
+    Accumulation *accumulation = &ray_tracer.accumulation;
+    if (accumulation->render_mode != render_mode) {
+        accumulation->render_mode = render_mode;
+        accumulation->sample_count = 0;
+    }
+
+    u32 new_sample_count = MAX_ACCUMULATED_SAMPLE_COUNT - accumulation->sample_count;
+    if (new_sample_count > ray_tracer.rays_per_pixel) new_sample_count = ray_tracer.rays_per_pixel;
+    if (new_sample_count > MAX_RAYS_PER_PIXEL) new_sample_count = MAX_RAYS_PER_PIXEL;
+    accumulation->new_sample_count = new_sample_count;
+
+    vec3 *offset = accumulation->ray_direction_offsets, down_offset;
+    for (u32 i = 0; i < new_sample_count; i++, offset++) {
+        scaleVec3(right, getSubpixelOffset(accumulation->sample_count + i, 2), offset);
+        scaleVec3(down,  getSubpixelOffset(accumulation->sample_count + i, 3), &down_offset);
+        iaddVec3(offset, &down_offset);
+    }
+
+    dispatchJobs(&worker_pool, accumulateTileOnCPU, tiles->count);
+    accumulation->sample_count += new_sample_count;
+    invalidateFrame();
+}
+
+inline void addRayCounts(RayCounts *counts, RayCounts *to) {
+    to->primary_rays    += counts->primary_rays;
+    to->shadow_rays     += counts->shadow_rays;
+    to->any_hits        += counts->any_hits;
+    to->primitive_tests += counts->primitive_tests;
+}
+
+inline u64 getRayCount(RayCounts *counts) {
+    return counts->primary_rays + counts->shadow_rays;
+}
+
+// Collects the rays the workers traced for the frame that was just rendered (in the given ticks):
+void updateRayStats(u64 render_ticks) {
+    RayStats *stats = &ray_tracer.ray_stats;
+    RayCounts *worker_counts = stats->worker_counts;
+    memset(&stats->frame, 0, sizeof(RayCounts));
+    for (u32 i = 0; i < worker_pool.worker_count; i++, worker_counts++) addRayCounts(worker_counts, &stats->frame);
+    memset(stats->worker_counts, 0, sizeof(RayCounts) * worker_pool.worker_count);
+
+    stats->frame_ticks = render_ticks;
+    stats->accumulated_ticks += render_ticks;
+    addRayCounts(&stats->frame, &stats->accumulated);
+    if (stats->accumulated_ticks >= ticks_per_second) {
+        stats->megarays_per_second = (f64)getRayCount(&stats->accumulated) / (stats->accumulated_ticks * microseconds_per_tick);
+        stats->accumulated_ticks = 0;
+        memset(&stats->accumulated, 0, sizeof(RayCounts));
     }
 }
 
 void onZoom() {
+    ray_tracer.ray_directions_changed = true;
     current_camera_controller->moved = true;
     current_camera_controller->zoomed = false;
 }
@@ -61,6 +1030,7 @@ void onTurn() {
                   &current_camera_controller->camera->transform.rotation_matrix_inverted);
     current_camera_controller->turned = false;
     current_camera_controller->moved = true;
+    ray_tracer.ray_directions_changed = true;
 }
 
 void onMove(Scene* scene) {
@@ -68,40 +1038,76 @@ void onMove(Scene* scene) {
     vec3 *cam_position = &current_camera_controller->camera->transform.position;
     mat3 *cam_rotation = &current_camera_controller->camera->transform.rotation_matrix_inverted;
     Node *node, **node_ptr;
-    u8 geo_count;
+    u16 geo_count;
 
     for (u8 geo_type = 0; geo_type < GEO_TYPE_COUNT; geo_type++) {
         switch (geo_type) {
             case GeoTypeCube:
-                geo_count = CUBE_COUNT;
+                geo_count = scene->cube_count;
                 geo_position_in_view_space = ray_tracer.ssb.view_positions.cubes;
                 node_ptr = scene->node_ptrs.cubes;
                 break;
             case GeoTypeSphere:
-                geo_count = SPHERE_COUNT;
+                geo_count = scene->sphere_count;
                 geo_position_in_view_space = ray_tracer.ssb.view_positions.spheres;
                 node_ptr = scene->node_ptrs.spheres;
                 break;
             case GeoTypeTetrahedron:
-                geo_count = TETRAHEDRON_COUNT;
+                geo_count = scene->tetrahedron_count;
                 geo_position_in_view_space = ray_tracer.ssb.view_positions.tetrahedra;
                 node_ptr = scene->node_ptrs.tetrahedra;
                 break;
+            case GeoTypeMesh:
+                geo_count = scene->mesh_count;
+                geo_position_in_view_space = ray_tracer.ssb.view_positions.meshes;
+                node_ptr = scene->node_ptrs.meshes;
+                break;
             default:
                 continue;
         }
-        for (u8 i = 0; i < geo_count; i++, geo_position_in_view_space++, node_ptr++) {
+        for (u16 i = 0; i < geo_count; i++, geo_position_in_view_space++, node_ptr++) {
             node = *node_ptr;
             subVec3(&node->position, cam_position, geo_position_in_view_space);
             imulVec3Mat3(geo_position_in_view_space, cam_rotation);
         }
     }
     updateSceneMasks(scene, &ray_tracer.ssb, &ray_tracer.masks, current_camera_controller->camera->focal_length);
+    restartAccumulation();
+    ray_tracer.reprojection.is_moving = true; // Invalidates the frame unless it gets reprojected (see renderChangesOnCPU)
+    frame_changes |= CAMERA_CHANGED;
 
     current_camera_controller->moved = false;
 }
 
+// Per-pixel buffers follow the layout of the frame buffer, and get reallocated along with it:
+void allocatePixelBuffers() {
+    ray_tracer.ray_count = frame_buffer.size;
+    ray_tracer.accumulation.color_sums = AllocPixelsN(vec3, ray_tracer.ray_count);
+    ray_tracer.ray_directions     = AllocPixelsN(vec3, ray_tracer.ray_count);
+    ray_tracer.ray_directions_rcp = AllocPixelsN(vec3, ray_tracer.ray_count);
+    ray_tracer.primary_hits       = AllocPixelsN(RayHit, ray_tracer.ray_count);
+
+    Reprojection *reprojection = &ray_tracer.reprojection;
+    reprojection->last_hits  = AllocPixelsN(RayHit, ray_tracer.ray_count);
+    reprojection->last_image = AllocPixelsN(Pixel, ray_tracer.ray_count);
+    reprojection->ages       = AllocPixelsN(u8, ray_tracer.ray_count);
+    reprojection->last_ages  = AllocPixelsN(u8, ray_tracer.ray_count);
+    reprojection->is_chained = false;
+    ray_tracer.checkerboard.has_history = false;
+    ray_tracer.cost_map.costs = 0; // Reallocated on its next use
+
+    DirtyRegions *dirty_regions = &ray_tracer.dirty_regions;
+    dirty_regions->image = AllocPixelsN(Pixel, frame_buffer.size);
+    dirty_regions->tile_bit_count = (u32)((frame_buffer.dimentions.width  + TILE_SIZE - 1) / TILE_SIZE) *
+                                         ((frame_buffer.dimentions.height + TILE_SIZE - 1) / TILE_SIZE);
+    dirty_regions->tiles = AllocPixelsN(u64, BITSET_WORD_COUNT(dirty_regions->tile_bit_count));
+    clearBitset(dirty_regions->tiles, dirty_regions->tile_bit_count);
+    dirty_regions->is_full = true;
+}
+
 void onResize(Scene *scene) {
+    allocatePixelBuffers();
+    ray_tracer.ray_directions_changed = true;
     onMove(scene);
 }
 
@@ -172,73 +1178,117 @@ void onRender(Scene *scene, Camera *camera) {
     scaleVec3(R, 2, r);
     scaleVec3(U, -2, d);
 
+    u64 render_ticks = getTicks();
 #ifdef __CUDACC__
-    if (use_GPU) renderOnGPU(Ro, s, r, d);
-    else         renderOnCPU(Ro, s, r, d);
+    // Meshes, accumulation, checkerboarding and the Cost mode render on the CPU only:
+    if (use_GPU && !scene->mesh_count && !accumulate && !checkerboard_rendering && render_mode != Cost) {
+        renderOnGPU(Ro, s, r, d);
+        invalidateFrame();
+    } else renderOnCPU(Ro, s, r, d);
 #else
     renderOnCPU(Ro, s, r, d);
 #endif
+    updateRayStats(getTicks() - render_ticks);
+    ray_tracer.reprojection.is_moving = false;
 
     if (show_BVH) drawBVH(&ray_tracer.bvh, camera);
-    if (show_SSB) drawSSB(&ray_tracer.ssb);
+    if (show_SSB) drawSSB(&ray_tracer.ssb, scene);
 }
 
 
 void initRayTracer(Scene *scene) {
-    initBVH(&ray_tracer.bvh, 7);
-    updateBVH(&ray_tracer.bvh, scene);
+    // Platforms may preset the worker count, otherwise use a worker per core:
+    initWorkerPool(&worker_pool, worker_pool.worker_count ? worker_pool.worker_count : getCoreCount());
+    initPacketKernels();
+    // Scene files may come with a prebuilt BVH:
+    if (!ray_tracer.bvh.node_count) {
+        u32 geometry_count = getSceneGeometryCount(scene);
+        if (initBVH(&ray_tracer.bvh, geometry_count)) updateBVH(&ray_tracer.bvh, scene);
+        else if (geometry_count) printDebugString("Not enough memory for the BVH, the scene's geometry is not shown\n");
+    }
 
-    ray_tracer.rays_per_pixel = 1;
-    ray_tracer.ray_count = ray_tracer.rays_per_pixel * MAX_WIDTH * MAX_HEIGHT;
-    ray_tracer.ray_directions     = AllocN(vec3, ray_tracer.ray_count);
-    ray_tracer.ray_directions_rcp = AllocN(vec3, ray_tracer.ray_count);
+    ray_tracer.rays_per_pixel = 1; // Samples added per frame while accumulating
+    allocatePixelBuffers();
+    ray_tracer.ray_stats.worker_counts = AllocAlignedN(RayCounts, worker_pool.worker_count, sizeof(RayCounts));
+    memset(ray_tracer.ray_stats.worker_counts, 0, sizeof(RayCounts) * worker_pool.worker_count);
+
+    SSB *ssb = &ray_tracer.ssb;
+    ssb->bounds.cubes      = AllocN(Bounds2Di, scene->cube_count);
+    ssb->bounds.spheres    = AllocN(Bounds2Di, scene->sphere_count);
+    ssb->bounds.tetrahedra = AllocN(Bounds2Di, scene->tetrahedron_count);
+    ssb->bounds.meshes     = AllocN(Bounds2Di, scene->mesh_count);
+    ssb->view_positions.cubes      = AllocN(vec3, scene->cube_count);
+    ssb->view_positions.spheres    = AllocN(vec3, scene->sphere_count);
+    ssb->view_positions.tetrahedra = AllocN(vec3, scene->tetrahedron_count);
+    ssb->view_positions.meshes     = AllocN(vec3, scene->mesh_count);
+
+    initWorkerMemory(worker_pool.worker_count);
 
     Node *node, **node_ptr;
-    u8 node_id, geo_count, *shadowing, *visibility, *transparency;
+    u16 geo_count;
+    u64 *shadowing, *visibility, *transparency;
     for (u8 geo_type = 0; geo_type < GEO_TYPE_COUNT; geo_type++) {
-        node_id = 1;
-
         switch (geo_type) {
             case GeoTypeCube:
-                geo_count = CUBE_COUNT;
-                shadowing    = &ray_tracer.masks.shadowing.cubes;
-                visibility   = &ray_tracer.masks.visibility.cubes;
-                transparency = &ray_tracer.masks.transparency.cubes;
+                geo_count = scene->cube_count;
                 node_ptr = scene->node_ptrs.cubes;
                 break;
             case GeoTypeSphere:
-                geo_count = SPHERE_COUNT;
-                shadowing    = &ray_tracer.masks.shadowing.spheres;
-                visibility   = &ray_tracer.masks.visibility.spheres;
-                transparency = &ray_tracer.masks.transparency.spheres;
+                geo_count = scene->sphere_count;
                 node_ptr = scene->node_ptrs.spheres;
                 break;
             case GeoTypeTetrahedron:
-                geo_count = TETRAHEDRON_COUNT;
-                shadowing    = &ray_tracer.masks.shadowing.tetrahedra;
-                visibility   = &ray_tracer.masks.visibility.tetrahedra;
-                transparency = &ray_tracer.masks.transparency.tetrahedra;
+                geo_count = scene->tetrahedron_count;
                 node_ptr = scene->node_ptrs.tetrahedra;
                 break;
+            case GeoTypeMesh:
+                geo_count = scene->mesh_count;
+                node_ptr = scene->node_ptrs.meshes;
+                break;
             default:
                 continue;
         }
 
-        *shadowing    = 0;
-        *visibility   = 0;
-        *transparency = 0;
+        shadowing    = AllocN(u64, BITSET_WORD_COUNT(geo_count));
+        visibility   = AllocN(u64, BITSET_WORD_COUNT(geo_count));
+        transparency = AllocN(u64, BITSET_WORD_COUNT(geo_count));
+        clearBitset(shadowing,    geo_count);
+        clearBitset(visibility,   geo_count);
+        clearBitset(transparency, geo_count);
 
-        for (u8 i = 0; i < geo_count; i++, node_id <<= (u8)1, node_ptr++) {
+        for (u16 i = 0; i < geo_count; i++, node_ptr++) {
             node = *node_ptr;
             if (scene->materials[node->geo.material_id].uses & (u8) TRANSPARENCY)
-                *transparency |= node_id;
-            *visibility |= node_id;
+                setBit(transparency, i);
+            setBit(visibility, i);
+        }
+
+        switch (geo_type) {
+            case GeoTypeCube:
+                ray_tracer.masks.shadowing.cubes    = shadowing;
+                ray_tracer.masks.visibility.cubes   = visibility;
+                ray_tracer.masks.transparency.cubes = transparency;
+                break;
+            case GeoTypeSphere:
+                ray_tracer.masks.shadowing.spheres    = shadowing;
+                ray_tracer.masks.visibility.spheres   = visibility;
+                ray_tracer.masks.transparency.spheres = transparency;
+                break;
+            case GeoTypeTetrahedron:
+                ray_tracer.masks.shadowing.tetrahedra    = shadowing;
+                ray_tracer.masks.visibility.tetrahedra   = visibility;
+                ray_tracer.masks.transparency.tetrahedra = transparency;
+                break;
+            default:
+                ray_tracer.masks.shadowing.meshes    = shadowing;
+                ray_tracer.masks.visibility.meshes   = visibility;
+                ray_tracer.masks.transparency.meshes = transparency;
         }
     }
 
-    ray_tracer.masks.shadowing.cubes = 0;
-    ray_tracer.masks.shadowing.spheres = FULL_MASK;
-    ray_tracer.masks.shadowing.tetrahedra = 0;
+    // Only spheres and meshes cast shadows:
+    fillBitset(ray_tracer.masks.shadowing.spheres, scene->sphere_count);
+    fillBitset(ray_tracer.masks.shadowing.meshes, scene->mesh_count);
 }
 
 //#ifdef __CUDACC__
@@ -53,4 +53,25 @@ void shadeDirectionAndDepth(vec3* direction, f32 distance, vec3* out_color) {
     out_color->x = factor * (direction->x + 1);
     out_color->y = factor * (direction->y + 1);
     out_color->z = factor * (direction->z + 1);
-}
\ No newline at end of file
+}
+
+// A false colour ramp from blue (0) through cyan, green and yellow to red (1):
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void shadeHeat(f32 heat, vec3* out_color) {
+    f32 t = 4 * (heat < 0 ? 0 : (heat > 1 ? 1 : heat));
+    if (t < 1) {
+        out_color->x = 0;     out_color->y = t;     out_color->z = 1;
+    } else if (t < 2) {
+        out_color->x = 0;     out_color->y = 1;     out_color->z = 2 - t;
+    } else if (t < 3) {
+        out_color->x = t - 2; out_color->y = 1;     out_color->z = 0;
+    } else {
+        out_color->x = 1;     out_color->y = 4 - t; out_color->z = 0;
+    }
+}
@@ -36,9 +36,13 @@ void shadeReflection(Scene *scene, BVHNode *bvh_nodes, Masks *scene_masks, u8 ma
         fillVec3(&color, 0);
         u8 new_hit_depth = depth + 1;
         if (new_hit_depth < MAX_HIT_DEPTH) {
+            vec3 RLd_rcp;
+            reciprocalVec3(RLd, &RLd_rcp);
+
             Ray ray;
             ray.origin = P;
             ray.direction = RLd;
+            ray.direction_rcp = &RLd_rcp;
 
             traceSecondaryRay(&ray, scene, bvh_nodes, scene_masks);
             shadeReflection(scene, bvh_nodes, scene_masks, ray.hit.material_id, RLd, &ray.hit.position, &ray.hit.normal, new_hit_depth, &color);
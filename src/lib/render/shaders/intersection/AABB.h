@@ -23,7 +23,33 @@ bool hitAABB(vec3 *aabb_min, vec3 *aabb_max, vec3 *Ro, vec3* RD_rcp) {
     ) >= max(0.0f, max(max(min(min_t_x, max_t_x), min(min_t_y, max_t_y)), min(min_t_z, max_t_z)));
 }
 
+// Returns the distance at which the ray enters the box (or starts within it), infinity when it misses the box:
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+f32 getAABBHitDistance(vec3 *aabb_min, vec3 *aabb_max, vec3 *Ro, vec3* RD_rcp) {
+    f32 min_x = aabb_min->x, max_x = aabb_max->x, Ox = Ro->x, Dx = RD_rcp->x, min_t_x = (min_x - Ox) * Dx, max_t_x = (max_x - Ox) * Dx,
+        min_y = aabb_min->y, max_y = aabb_max->y, Oy = Ro->y, Dy = RD_rcp->y, min_t_y = (min_y - Oy) * Dy, max_t_y = (max_y - Oy) * Dy,
+        min_z = aabb_min->z, max_z = aabb_max->z, Oz = Ro->z, Dz = RD_rcp->z, min_t_z = (min_z - Oz) * Dz, max_t_z = (max_z - Oz) * Dz;
+
+    f32 enter = max(0.0f, max(max(min(min_t_x, max_t_x), min(min_t_y, max_t_y)), min(min_t_z, max_t_z))),
+        exit  = min(min(max(min_t_x, max_t_x), max(min_t_y, max_t_y)), max(min_t_z, max_t_z));
+
+    return exit >= enter ? enter : INFINITY;
+}
+
 inline void setAABBfromNode(AABB *aabb, Node *node) {
+    if (node->geo.type == GeoTypeMesh) { // Meshes have tighter bounds, from the root of their BVH:
+        AABB *mesh_aabb = &((Mesh*)node)->bvh_nodes->aabb;
+        addVec3(&mesh_aabb->min, &node->position, &aabb->min);
+        addVec3(&mesh_aabb->max, &node->position, &aabb->max);
+        return;
+    }
+
     f32 r = node->radius,
         x = node->position.x,
         y = node->position.y,
@@ -15,44 +15,38 @@ __forceinline__
 #else
 inline
 #endif
-bool hitCubes(Cube *cubes, Indices *indices, Ray *ray, u8 visibility, bool check_any) {
+bool hitCube(Cube *cube, Indices *indices, Ray *ray, bool check_any) {
     vec3 hit_position, hit_position_tangent;
     vec3 *Ro = ray->origin,
          *Rd = ray->direction;
     f32 x, y, distance, closest_distance = ray->hit.distance;
-    u8 q, cude_id = 1;
     bool found = false;
 
-    // Loop over all tetrahedra and intersect the ray against them:
-    Cube* cube = cubes;
+    // Loop over the faces of the cube and intersect the ray against them:
     vec3 *v1, *n;
 
-    for (u8 i = 0; i < CUBE_COUNT; i++, cube++, cude_id <<= 1) {
-        if (!(cude_id & visibility)) continue;
+    for (u8 q = 0; q < 6; q++) {
+        v1 = &cube->vertices[indices[q].v1];
+        n = &cube->tangent_to_world[q].Z;
+        if (hitPlane(v1, n, Rd, Ro, &distance)) {
+            if (distance < closest_distance) {
+                scaleVec3(Rd, distance, &hit_position);
+                iaddVec3(&hit_position, Ro);
 
-        for (q = 0; q < 6; q++) {
-            v1 = &cube->vertices[indices[q].v1];
-            n = &cube->tangent_to_world[q].Z;
-            if (hitPlane(v1, n, Rd, Ro, &distance)) {
-                if (distance < closest_distance) {
-                    scaleVec3(Rd, distance, &hit_position);
-                    iaddVec3(&hit_position, Ro);
+                subVec3(&hit_position, v1, &hit_position_tangent);
+                imulVec3Mat3(&hit_position_tangent, &cube->world_to_tangent[q]);
 
-                    subVec3(&hit_position, v1, &hit_position_tangent);
-                    imulVec3Mat3(&hit_position_tangent, &cube->world_to_tangent[q]);
+                x = hit_position_tangent.x;
+                y = hit_position_tangent.y;
 
-                    x = hit_position_tangent.x;
-                    y = hit_position_tangent.y;
-
-                    if (x > 0 && y > 0 && x < 1 && y < 1) {
-                        ray->hit.is_back_facing = false;
-                        ray->hit.material_id = cube->node.geo.material_id;
-                        ray->hit.distance = closest_distance = distance;
-                        ray->hit.position = hit_position;
-                        ray->hit.normal = *n;
-                        found = true;
-                        if (check_any) break;
-                    }
+                if (x > 0 && y > 0 && x < 1 && y < 1) {
+                    ray->hit.is_back_facing = false;
+                    ray->hit.material_id = cube->node.geo.material_id;
+                    ray->hit.distance = closest_distance = distance;
+                    ray->hit.position = hit_position;
+                    ray->hit.normal = *n;
+                    found = true;
+                    if (check_any) break;
                 }
             }
         }
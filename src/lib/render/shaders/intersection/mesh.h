@@ -0,0 +1,94 @@
+#pragma once
+
+#include <math.h>
+
+#include "lib/core/types.h"
+#include "lib/math/math3D.h"
+#include "lib/globals/scene.h"
+#include "lib/globals/raytracing.h"
+#include "triangle.h"
+#include "AABB.h"
+
+// Traverses the mesh's BVH nearest child first, skipping nodes beyond the closest hit so far:
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+bool hitMesh(Mesh *mesh, Ray *ray, bool check_any) {
+    vec3 Ro, *Rd = ray->direction, *Rd_rcp = ray->direction_rcp;
+    subVec3(ray->origin, &mesh->node.position, &Ro);
+
+    MeshBVHNode *node, *left, *right;
+    TriangleIndices *triangle, *closest_triangle = 0;
+    vec3 *vertices = mesh->vertices;
+    vec2 uv, closest_uv = {0, 0};
+    f32 distance, left_distance, right_distance,
+        closest_distance = ray->hit.distance,
+        stack_distances[MAX_BVH_DEPTH];
+    u32 left_id, right_id, stack[MAX_BVH_DEPTH];
+    u8 stack_size = 1;
+    bool found = false;
+
+    stack[0] = 0;
+    stack_distances[0] = getAABBHitDistance(&mesh->bvh_nodes->aabb.min, &mesh->bvh_nodes->aabb.max, &Ro, Rd_rcp);
+    while (stack_size) {
+        if (stack_distances[--stack_size] >= closest_distance) continue;
+
+        node = mesh->bvh_nodes + stack[stack_size];
+        countRayCost(CostBVHNodesVisited, 1);
+        if (node->count) {
+            countIntersectionTests(node->count);
+            triangle = mesh->triangles + node->first;
+            for (u32 i = 0; i < node->count; i++, triangle++)
+                if (hitTriangle(vertices + triangle->v1,
+                                vertices + triangle->v2,
+                                vertices + triangle->v3, &Ro, Rd, &distance, &uv) && distance < closest_distance) {
+                    closest_distance = distance;
+                    closest_triangle = triangle;
+                    closest_uv = uv;
+                    found = true;
+                    if (check_any) break;
+                }
+
+            if (found && check_any) break;
+            continue;
+        }
+
+        left_id = node->first;
+        right_id = left_id + 1;
+        left = mesh->bvh_nodes + left_id;
+        right = left + 1;
+        left_distance  = getAABBHitDistance(&left->aabb.min,  &left->aabb.max,  &Ro, Rd_rcp);
+        right_distance = getAABBHitDistance(&right->aabb.min, &right->aabb.max, &Ro, Rd_rcp);
+        if (left_distance < right_distance) {
+            if (right_distance < closest_distance) { stack_distances[stack_size] = right_distance; stack[stack_size++] = right_id; }
+            if (left_distance  < closest_distance) { stack_distances[stack_size] = left_distance;  stack[stack_size++] = left_id; }
+        } else {
+            if (left_distance  < closest_distance) { stack_distances[stack_size] = left_distance;  stack[stack_size++] = left_id; }
+            if (right_distance < closest_distance) { stack_distances[stack_size] = right_distance; stack[stack_size++] = right_id; }
+        }
+    }
+
+    if (found) {
+        vec3 e1, e2, *N = &ray->hit.normal;
+        subVec3(vertices + closest_triangle->v2, vertices + closest_triangle->v1, &e1);
+        subVec3(vertices + closest_triangle->v3, vertices + closest_triangle->v1, &e2);
+        crossVec3(&e1, &e2, N);
+        norm3(N);
+
+        ray->hit.is_back_facing = dotVec3(N, Rd) > 0;
+        if (ray->hit.is_back_facing) invertVec3(N);
+
+        // Pulled back towards the ray's side so that rays leaving the surface do not hit it again:
+        scaleVec3(Rd, closest_distance - EPS, &ray->hit.position);
+        iaddVec3(&ray->hit.position, ray->origin);
+        ray->hit.distance = closest_distance;
+        ray->hit.material_id = mesh->node.geo.material_id;
+        ray->hit.uv = closest_uv;
+    }
+
+    return found;
+}
@@ -32,6 +32,43 @@ bool hitPlane(vec3 *position, vec3 *normal, vec3 *ray_direction, vec3 *ray_origi
     return true;
 }
 
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void setRayPlaneHit(Ray *ray, Plane *hit_plane, f32 closest_hit_distance) {
+    setRayHitPosition(ray->origin, ray->direction, closest_hit_distance - EPS, &ray->hit.position);
+    ray->hit.material_id = hit_plane->node.geo.material_id;
+    ray->hit.normal = hit_plane->normal;
+    ray->hit.distance = closest_hit_distance;
+    f32 x = ray->hit.position.x + 32; x *= 0.125f; x -= (f32)((u8)x);
+    f32 y = ray->hit.position.y + 32; y *= 0.125f; y -= (f32)((u8)y);
+    f32 z = ray->hit.position.z + 32; z *= 0.125f; z -= (f32)((u8)z);
+    if (       hit_plane->normal.x > 0) { // Left plane (facing right):
+        ray->hit.uv.x = z;
+        ray->hit.uv.y = y;
+    } else if (hit_plane->normal.x < 0) { // Right plane (facing left):
+        ray->hit.uv.x = 1 - z;
+        ray->hit.uv.y = y;
+    } else if (hit_plane->normal.y > 0) { // Bottom plane (facing up):
+        ray->hit.uv.x = x;
+        ray->hit.uv.y = z;
+    } else if (hit_plane->normal.y < 0) { // Top plane (facing down):
+        ray->hit.uv.x = x;
+        ray->hit.uv.y = 1 - z;
+    } else if (hit_plane->normal.z > 0) { // Back plane (facing forward):
+        ray->hit.uv.x = 1 - x;
+        ray->hit.uv.y = y;
+    } else if (hit_plane->normal.z < 0) { // Front plane (facing backward):
+        ray->hit.uv.x = x;
+        ray->hit.uv.y = y;
+    }
+    ray->hit.is_back_facing = false;
+}
+
 #ifdef __CUDACC__
 __device__
 __host__
@@ -60,35 +97,7 @@ bool hitPlanes(Plane *planes, Ray* ray) {
         }
     }
 
-    if (found) {
-        setRayHitPosition(Ro, Rd, closest_hit_distance - EPS, &ray->hit.position);
-        ray->hit.material_id = hit_plane->node.geo.material_id;
-        ray->hit.normal = hit_plane->normal;
-        ray->hit.distance = closest_hit_distance;
-        f32 x = ray->hit.position.x + 32; x *= 0.125f; x -= (f32)((u8)x);
-        f32 y = ray->hit.position.y + 32; y *= 0.125f; y -= (f32)((u8)y);
-        f32 z = ray->hit.position.z + 32; z *= 0.125f; z -= (f32)((u8)z);
-        if (       hit_plane->normal.x > 0) { // Left plane (facing right):
-            ray->hit.uv.x = z;
-            ray->hit.uv.y = y;
-        } else if (hit_plane->normal.x < 0) { // Right plane (facing left):
-            ray->hit.uv.x = 1 - z;
-            ray->hit.uv.y = y;
-        } else if (hit_plane->normal.y > 0) { // Bottom plane (facing up):
-            ray->hit.uv.x = x;
-            ray->hit.uv.y = z;
-        } else if (hit_plane->normal.y < 0) { // Top plane (facing down):
-            ray->hit.uv.x = x;
-            ray->hit.uv.y = 1 - z;
-        } else if (hit_plane->normal.z > 0) { // Back plane (facing forward):
-            ray->hit.uv.x = 1 - x;
-            ray->hit.uv.y = y;
-        } else if (hit_plane->normal.z < 0) { // Front plane (facing backward):
-            ray->hit.uv.x = x;
-            ray->hit.uv.y = y;
-        }
-        ray->hit.is_back_facing = false;
-    }
+    if (found) setRayPlaneHit(ray, hit_plane, closest_hit_distance);
 
     return found;
 }
\ No newline at end of file
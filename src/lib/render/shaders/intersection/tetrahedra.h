@@ -16,44 +16,38 @@ __forceinline__
 #else
 inline
 #endif
-bool hitTetrahedra(Tetrahedron *tetrahedra, Indices *indices, Ray *ray, u8 visibility_mask, bool check_any) {
+bool hitTetrahedron(Tetrahedron *tetrahedron, Indices *indices, Ray *ray, bool check_any) {
     vec3 hit_position, hit_position_tangent;
     vec3 *Ro = ray->origin,
          *Rd = ray->direction;
     f32 x, y, distance, closest_distance = ray->hit.distance;
-    u8 t, tetrahedron_id = 1;
     bool found = false;
 
-    // Loop over all tetrahedra and intersect the ray against them:
-    Tetrahedron* tetrahedron = tetrahedra;
+    // Loop over the faces of the tetrahedron and intersect the ray against them:
     vec3 *v1, *n;
 
-    for (u8 i = 0; i < TETRAHEDRON_COUNT; i++, tetrahedron++, tetrahedron_id <<= 1) {
-        if (!(tetrahedron_id & visibility_mask)) continue;
+    for (u8 t = 0; t < 4; t++) {
+        v1 = &tetrahedron->vertices[indices[t].v1];
+        n = &tetrahedron->tangent_to_world[t].Z;
+        if (hitPlane(v1, n, Rd, Ro, &distance)) {
+            if (distance < closest_distance) {
+                scaleVec3(Rd, distance, &hit_position);
+                iaddVec3(&hit_position, Ro);
 
-        for (t = 0; t < 4; t++) {
-            v1 = &tetrahedron->vertices[indices[t].v1];
-            n = &tetrahedron->tangent_to_world[t].Z;
-            if (hitPlane(v1, n, Rd, Ro, &distance)) {
-                if (distance < closest_distance) {
-                    scaleVec3(Rd, distance, &hit_position);
-                    iaddVec3(&hit_position, Ro);
+                subVec3(&hit_position, v1, &hit_position_tangent);
+                imulVec3Mat3(&hit_position_tangent, &tetrahedron->world_to_tangent[t]);
 
-                    subVec3(&hit_position, v1, &hit_position_tangent);
-                    imulVec3Mat3(&hit_position_tangent, &tetrahedron->world_to_tangent[t]);
+                x = hit_position_tangent.x;
+                y = hit_position_tangent.y;
 
-                    x = hit_position_tangent.x;
-                    y = hit_position_tangent.y;
-
-                    if (x > 0 && y > 0 && y < (1 - x)) {
-                        ray->hit.is_back_facing = false;
-                        ray->hit.material_id = tetrahedron->node.geo.material_id;
-                        ray->hit.distance = closest_distance = distance;
-                        ray->hit.position = hit_position;
-                        ray->hit.normal = *n;
-                        found = true;
-                        if (check_any) break;
-                    }
+                if (x > 0 && y > 0 && y < (1 - x)) {
+                    ray->hit.is_back_facing = false;
+                    ray->hit.material_id = tetrahedron->node.geo.material_id;
+                    ray->hit.distance = closest_distance = distance;
+                    ray->hit.position = hit_position;
+                    ray->hit.normal = *n;
+                    found = true;
+                    if (check_any) break;
                 }
             }
         }
@@ -4,9 +4,9 @@
 
 #include "lib/core/types.h"
 #include "lib/math/math3D.h"
-#include "lib/globals/scene.h"
-#include "lib/globals/raytracing.h"
 
+// Moller-Trumbore: Sets the distance along the ray and the barycentric coordinates (of v2 and v3) of the hit.
+// Triangles are double-sided:
 #ifdef __CUDACC__
 __device__
 __host__
@@ -14,53 +14,26 @@ __forceinline__
 #else
 inline
 #endif
-bool hitTriangles(RayHit* closest_hit, Material** material_ptr) {
-    vec3 *Rd = &closest_hit->ray_direction;
-    vec3 *Ro = &closest_hit->ray_origin;
-    vec3 hit_position, closest_hit_position, closest_hit_normal;
-    f32 hit_distance, closest_hit_distance = closest_hit->distance;
-    Material *closest_hit_material = NULL;
-    bool found = false;
-
-    // Loop over all tetrahedra and intersect the ray against them:
-    Triangle* last_triangle = scene.triangles + scene.triangle_count;
-    for (Triangle* triangle = scene.triangles; triangle != last_triangle; triangle++) {
-        if (hitPlane(triangle->p1, triangle->normal, Rd, Ro, &hit_distance) && hit_distance < closest_hit_distance) {
-
-            scaleVec3(Rd, hit_distance, &hit_position);
-            iaddVec3(&hit_position, Ro);
-
-            vec3 p1p2; subVec3(triangle->p2, triangle->p1, &p1p2);
-            vec3 p2p3; subVec3(triangle->p3, triangle->p2, &p2p3);
-            vec3 p3p1; subVec3(triangle->p1, triangle->p3, &p3p1);
-
-            vec3 p1P; subVec3(&hit_position, triangle->p1, &p1P);
-            vec3 p2P; subVec3(&hit_position, triangle->p2, &p2P);
-            vec3 p3P; subVec3(&hit_position, triangle->p3, &p3P);
-
-            vec3 c1; crossVec3(&p1P, &p1p2, &c1);
-            vec3 c2; crossVec3(&p2P, &p2p3, &c2);
-            vec3 c3; crossVec3(&p3P, &p3p1, &c3);
-
-            if (dotVec3(triangle->normal, &c1) > 0 &&
-                dotVec3(triangle->normal, &c2) > 0 &&
-                dotVec3(triangle->normal, &c3) > 0) {
-                closest_hit_distance = hit_distance;
-                closest_hit_position = hit_position;
-                closest_hit_normal   = *triangle->normal;
-//                closest_hit_material = tetrahedron->material;
-
-                found = true;
-            }
-        }
-    }
-
-    if (found) {
-        closest_hit->normal = closest_hit_normal;
-        closest_hit->position = closest_hit_position;
-        closest_hit->distance = closest_hit_distance;
-        *material_ptr = closest_hit_material;
-    }
-
-    return found;
-}
\ No newline at end of file
+bool hitTriangle(vec3 *v1, vec3 *v2, vec3 *v3, vec3 *Ro, vec3 *Rd, f32 *distance, vec2 *uv) {
+    vec3 e1, e2, p, t, q;
+    subVec3(v2, v1, &e1);
+    subVec3(v3, v1, &e2);
+    crossVec3(Rd, &e2, &p);
+
+    f32 det = dotVec3(&e1, &p);
+    if (det == 0) return false; // The ray is parallel to the triangle
+
+    f32 one_over_det = 1 / det;
+    subVec3(Ro, v1, &t);
+    f32 u = dotVec3(&t, &p) * one_over_det;
+    if (u < 0 || u > 1) return false;
+
+    crossVec3(&t, &e1, &q);
+    f32 v = dotVec3(Rd, &q) * one_over_det;
+    if (v < 0 || u + v > 1) return false;
+
+    *distance = dotVec3(&e2, &q) * one_over_det;
+    uv->x = u;
+    uv->y = v;
+    return *distance > 0;
+}
@@ -0,0 +1,482 @@
+#pragma once
+
+#include "lib/core/types.h"
+#include "lib/globals/scene.h"
+#include "lib/globals/raytracing.h"
+#include "lib/render/SSB.h"
+
+#include "trace.h"
+
+// Packets of coherent primary rays (same origin, neighbouring pixels of a row).
+// The SIMD kernels only find the closest plane and the candidate spheres, cubes and tetrahedra of each lane,
+// evaluating the exact same float expressions as the scalar kernels, which then finalize each lane's hit.
+// This way every lane ends up with the same RayHit that tracePrimaryRay would have produced.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define PACKET_SIMD
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define TARGET_AVX2
+    #else
+        #define TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+#define PACKET_WIDTH 8
+
+typedef struct {
+    _align(32) f32 Dx[PACKET_WIDTH];
+    _align(32) f32 Dy[PACKET_WIDTH];
+    _align(32) f32 Dz[PACKET_WIDTH];
+    _align(32) f32 closest_distance[PACKET_WIDTH];
+    _align(32) i32 plane_id[PACKET_WIDTH];
+} RayPacket;
+
+typedef void (*HitPlanesPacket)(FacesSoA *planes, vec3 *Ro, RayPacket *packet);
+// Finds the lanes each of the given spheres is a candidate for (a lane mask per sphere id):
+typedef void (*GetSphereCandidatesPacket)(NodesSoA *spheres, GeometryIds *sphere_ids, vec3 *Ro, RayPacket *packet, u8 *lanes);
+// Same for convex shapes of face_count faces (cubes or tetrahedra), clipping each lane against their face planes:
+typedef void (*GetConvexCandidatesPacket)(NodesSoA *nodes, FacesSoA *faces, u8 face_count, GeometryIds *ids, vec3 *Ro, RayPacket *packet, u8 *lanes);
+
+typedef struct {
+    HitPlanesPacket hitPlanes;
+    GetSphereCandidatesPacket getSphereCandidates;
+    GetConvexCandidatesPacket getConvexCandidates;
+} PacketKernels;
+PacketKernels packet_kernels;
+
+// The kernels stream the geometry from the SoA store (see SceneSoA):
+inline f32 getPlaneDistancePacket(FacesSoA *planes, i32 i, vec3 *Ro) {
+    return (planes->px[i] - Ro->x) * planes->nx[i] +
+           (planes->py[i] - Ro->y) * planes->ny[i] +
+           (planes->pz[i] - Ro->z) * planes->nz[i];
+}
+
+// The face planes of convex shapes get pushed out by this fraction of their radius before clipping,
+// so that rounding never drops a lane that the scalar kernels would hit:
+#define CONVEX_CANDIDATE_MARGIN 0.001f
+
+// Scalar:
+// ======
+void hitPlanesPacketScalar(FacesSoA *planes, vec3 *Ro, RayPacket *packet) {
+    f32 Rd_dot_n, p_dot_n, distance;
+
+    for (i32 i = 0; i < PLANE_COUNT; i++) {
+        p_dot_n = getPlaneDistancePacket(planes, i, Ro);
+        if (p_dot_n >= 0 || -p_dot_n < EPS) continue;
+
+        for (u8 lane = 0; lane < PACKET_WIDTH; lane++) {
+            Rd_dot_n = packet->Dx[lane] * planes->nx[i] + packet->Dy[lane] * planes->ny[i] + packet->Dz[lane] * planes->nz[i];
+            if (Rd_dot_n >= 0 || -Rd_dot_n < EPS) continue;
+
+            distance = p_dot_n / Rd_dot_n;
+            if (distance < packet->closest_distance[lane]) {
+                packet->closest_distance[lane] = distance;
+                packet->plane_id[lane] = i;
+            }
+        }
+    }
+}
+
+void getSphereCandidatesPacketScalar(NodesSoA *spheres, GeometryIds *sphere_ids, vec3 *Ro, RayPacket *packet, u8 *lanes) {
+    vec3 C;
+    f32 t, r, dt, Ix, Iy, Iz, closest;
+    u16 i;
+
+    for (u16 k = 0; k < sphere_ids->count; k++) {
+        i = sphere_ids->ids[k];
+        C.x = spheres->x[i] - Ro->x;
+        C.y = spheres->y[i] - Ro->y;
+        C.z = spheres->z[i] - Ro->z;
+        r = spheres->r[i];
+
+        lanes[k] = 0;
+        for (u8 lane = 0; lane < PACKET_WIDTH; lane++) {
+            t = C.x * packet->Dx[lane] + C.y * packet->Dy[lane] + C.z * packet->Dz[lane];
+            Ix = packet->Dx[lane] * t - C.x;
+            Iy = packet->Dy[lane] * t - C.y;
+            Iz = packet->Dz[lane] * t - C.z;
+            dt = r*r - (Ix*Ix + Iy*Iy + Iz*Iz);
+            closest = packet->closest_distance[lane];
+            if (t > 0 && dt > 0 && dt < closest * closest)
+                lanes[k] |= (u8)(1 << lane);
+        }
+    }
+}
+
+void getConvexCandidatesPacketScalar(NodesSoA *nodes, FacesSoA *faces, u8 face_count, GeometryIds *ids, vec3 *Ro, RayPacket *packet, u8 *lanes) {
+    vec3 C;
+    f32 t, r, margin, Ix, Iy, Iz, p_dot_n, Rd_dot_n, distance, enter, exit;
+    u32 face_id;
+    u16 i;
+
+    for (u16 k = 0; k < ids->count; k++) {
+        i = ids->ids[k];
+        C.x = nodes->x[i] - Ro->x;
+        C.y = nodes->y[i] - Ro->y;
+        C.z = nodes->z[i] - Ro->z;
+        margin = nodes->r[i] * CONVEX_CANDIDATE_MARGIN;
+        r = nodes->r[i] + margin;
+
+        lanes[k] = 0;
+        for (u8 lane = 0; lane < PACKET_WIDTH; lane++) {
+            // Bounding sphere:
+            t = C.x * packet->Dx[lane] + C.y * packet->Dy[lane] + C.z * packet->Dz[lane];
+            Ix = packet->Dx[lane] * t - C.x;
+            Iy = packet->Dy[lane] * t - C.y;
+            Iz = packet->Dz[lane] * t - C.z;
+            if (Ix*Ix + Iy*Iy + Iz*Iz >= r*r) continue;
+
+            // Clip the ray's distance range by the face planes (entering front faces, exiting back faces):
+            enter = -MAX_DISTANCE;
+            exit = MAX_DISTANCE;
+            face_id = (u32)i * face_count;
+            for (u8 f = 0; f < face_count; f++, face_id++) {
+                p_dot_n = getPlaneDistancePacket(faces, (i32)face_id, Ro) + margin;
+                Rd_dot_n = packet->Dx[lane] * faces->nx[face_id] + packet->Dy[lane] * faces->ny[face_id] + packet->Dz[lane] * faces->nz[face_id];
+                if (Rd_dot_n == 0) continue;
+
+                distance = p_dot_n / Rd_dot_n;
+                if (Rd_dot_n < 0) enter = max(enter, distance);
+                else              exit  = min(exit,  distance);
+            }
+            if (exit > 0 && enter <= exit && enter < packet->closest_distance[lane])
+                lanes[k] |= (u8)(1 << lane);
+        }
+    }
+}
+
+#ifdef PACKET_SIMD
+// SSE (2 x 4 lanes):
+// =================
+void hitPlanesPacketSSE(FacesSoA *planes, vec3 *Ro, RayPacket *packet) {
+    f32 p_dot_n;
+    __m128 Dx, Dy, Dz, Rd_dot_n, distance, closest, closer, plane_id;
+    __m128 minus_eps = _mm_set1_ps(-EPS);
+
+    for (u8 lane = 0; lane < PACKET_WIDTH; lane += 4) {
+        Dx = _mm_load_ps(packet->Dx + lane);
+        Dy = _mm_load_ps(packet->Dy + lane);
+        Dz = _mm_load_ps(packet->Dz + lane);
+        closest  = _mm_load_ps(packet->closest_distance + lane);
+        plane_id = _mm_load_ps((f32*)(packet->plane_id + lane));
+
+        for (i32 i = 0; i < PLANE_COUNT; i++) {
+            p_dot_n = getPlaneDistancePacket(planes, i, Ro);
+            if (p_dot_n >= 0 || -p_dot_n < EPS) continue;
+
+            Rd_dot_n = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(Dx, _mm_set1_ps(planes->nx[i])),
+                    _mm_mul_ps(Dy, _mm_set1_ps(planes->ny[i]))),
+                    _mm_mul_ps(Dz, _mm_set1_ps(planes->nz[i])));
+            distance = _mm_div_ps(_mm_set1_ps(p_dot_n), Rd_dot_n);
+            closer = _mm_and_ps(_mm_cmple_ps(Rd_dot_n, minus_eps), _mm_cmplt_ps(distance, closest));
+
+            closest  = _mm_or_ps(_mm_and_ps(closer, distance), _mm_andnot_ps(closer, closest));
+            plane_id = _mm_or_ps(_mm_and_ps(closer, _mm_castsi128_ps(_mm_set1_epi32(i))), _mm_andnot_ps(closer, plane_id));
+        }
+
+        _mm_store_ps(packet->closest_distance + lane, closest);
+        _mm_store_ps((f32*)(packet->plane_id + lane), plane_id);
+    }
+}
+
+void getSphereCandidatesPacketSSE(NodesSoA *spheres, GeometryIds *sphere_ids, vec3 *Ro, RayPacket *packet, u8 *lanes) {
+    u16 i;
+    __m128 Dx, Dy, Dz, Cx, Cy, Cz, r_squared, t, Ix, Iy, Iz, dt, closest, zero = _mm_setzero_ps();
+
+    for (u16 k = 0; k < sphere_ids->count; k++) {
+        i = sphere_ids->ids[k];
+        Cx = _mm_set1_ps(spheres->x[i] - Ro->x);
+        Cy = _mm_set1_ps(spheres->y[i] - Ro->y);
+        Cz = _mm_set1_ps(spheres->z[i] - Ro->z);
+        r_squared = _mm_set1_ps(spheres->r[i] * spheres->r[i]);
+
+        lanes[k] = 0;
+        for (u8 lane = 0; lane < PACKET_WIDTH; lane += 4) {
+            Dx = _mm_load_ps(packet->Dx + lane);
+            Dy = _mm_load_ps(packet->Dy + lane);
+            Dz = _mm_load_ps(packet->Dz + lane);
+            closest = _mm_load_ps(packet->closest_distance + lane);
+            closest = _mm_mul_ps(closest, closest);
+
+            t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Cx, Dx), _mm_mul_ps(Cy, Dy)), _mm_mul_ps(Cz, Dz));
+            Ix = _mm_sub_ps(_mm_mul_ps(Dx, t), Cx);
+            Iy = _mm_sub_ps(_mm_mul_ps(Dy, t), Cy);
+            Iz = _mm_sub_ps(_mm_mul_ps(Dz, t), Cz);
+            dt = _mm_sub_ps(r_squared, _mm_add_ps(_mm_add_ps(_mm_mul_ps(Ix, Ix), _mm_mul_ps(Iy, Iy)), _mm_mul_ps(Iz, Iz)));
+
+            lanes[k] |= (u8)(_mm_movemask_ps(_mm_and_ps(_mm_and_ps(
+                    _mm_cmpgt_ps(t, zero),
+                    _mm_cmpgt_ps(dt, zero)),
+                    _mm_cmplt_ps(dt, closest))) << lane);
+        }
+    }
+}
+
+void getConvexCandidatesPacketSSE(NodesSoA *nodes, FacesSoA *faces, u8 face_count, GeometryIds *ids, vec3 *Ro, RayPacket *packet, u8 *lanes) {
+    u32 face_id;
+    u16 i;
+    f32 margin;
+    __m128 Dx, Dy, Dz, Cx, Cy, Cz, r_squared, t, Ix, Iy, Iz, p_dot_n, Rd_dot_n, distance, enter, exit, candidate,
+           zero = _mm_setzero_ps(),
+           min_distance = _mm_set1_ps(-MAX_DISTANCE),
+           max_distance = _mm_set1_ps(MAX_DISTANCE);
+
+    for (u16 k = 0; k < ids->count; k++) {
+        i = ids->ids[k];
+        Cx = _mm_set1_ps(nodes->x[i] - Ro->x);
+        Cy = _mm_set1_ps(nodes->y[i] - Ro->y);
+        Cz = _mm_set1_ps(nodes->z[i] - Ro->z);
+        margin = nodes->r[i] * CONVEX_CANDIDATE_MARGIN;
+        r_squared = _mm_set1_ps((nodes->r[i] + margin) * (nodes->r[i] + margin));
+
+        lanes[k] = 0;
+        for (u8 lane = 0; lane < PACKET_WIDTH; lane += 4) {
+            Dx = _mm_load_ps(packet->Dx + lane);
+            Dy = _mm_load_ps(packet->Dy + lane);
+            Dz = _mm_load_ps(packet->Dz + lane);
+
+            t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Cx, Dx), _mm_mul_ps(Cy, Dy)), _mm_mul_ps(Cz, Dz));
+            Ix = _mm_sub_ps(_mm_mul_ps(Dx, t), Cx);
+            Iy = _mm_sub_ps(_mm_mul_ps(Dy, t), Cy);
+            Iz = _mm_sub_ps(_mm_mul_ps(Dz, t), Cz);
+            candidate = _mm_cmplt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(Ix, Ix), _mm_mul_ps(Iy, Iy)), _mm_mul_ps(Iz, Iz)), r_squared);
+            if (!_mm_movemask_ps(candidate)) continue;
+
+            enter = min_distance;
+            exit = max_distance;
+            face_id = (u32)i * face_count;
+            for (u8 f = 0; f < face_count; f++, face_id++) {
+                p_dot_n = _mm_set1_ps(getPlaneDistancePacket(faces, (i32)face_id, Ro) + margin);
+                Rd_dot_n = _mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(Dx, _mm_set1_ps(faces->nx[face_id])),
+                        _mm_mul_ps(Dy, _mm_set1_ps(faces->ny[face_id]))),
+                        _mm_mul_ps(Dz, _mm_set1_ps(faces->nz[face_id])));
+                distance = _mm_div_ps(p_dot_n, Rd_dot_n);
+                enter = _mm_max_ps(enter, _mm_or_ps(_mm_and_ps(_mm_cmplt_ps(Rd_dot_n, zero), distance), _mm_andnot_ps(_mm_cmplt_ps(Rd_dot_n, zero), min_distance)));
+                exit  = _mm_min_ps(exit,  _mm_or_ps(_mm_and_ps(_mm_cmpgt_ps(Rd_dot_n, zero), distance), _mm_andnot_ps(_mm_cmpgt_ps(Rd_dot_n, zero), max_distance)));
+            }
+
+            candidate = _mm_and_ps(_mm_and_ps(candidate,
+                    _mm_cmpgt_ps(exit, zero)),
+                    _mm_and_ps(_mm_cmple_ps(enter, exit), _mm_cmplt_ps(enter, _mm_load_ps(packet->closest_distance + lane))));
+            lanes[k] |= (u8)(_mm_movemask_ps(candidate) << lane);
+        }
+    }
+}
+
+// AVX2 (1 x 8 lanes):
+// ==================
+TARGET_AVX2 void hitPlanesPacketAVX2(FacesSoA *planes, vec3 *Ro, RayPacket *packet) {
+    f32 p_dot_n;
+    __m256 Rd_dot_n, distance, closer;
+    __m256 Dx = _mm256_load_ps(packet->Dx),
+           Dy = _mm256_load_ps(packet->Dy),
+           Dz = _mm256_load_ps(packet->Dz),
+           closest  = _mm256_load_ps(packet->closest_distance),
+           plane_id = _mm256_load_ps((f32*)packet->plane_id),
+           minus_eps = _mm256_set1_ps(-EPS);
+
+    for (i32 i = 0; i < PLANE_COUNT; i++) {
+        p_dot_n = getPlaneDistancePacket(planes, i, Ro);
+        if (p_dot_n >= 0 || -p_dot_n < EPS) continue;
+
+        Rd_dot_n = _mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(Dx, _mm256_set1_ps(planes->nx[i])),
+                _mm256_mul_ps(Dy, _mm256_set1_ps(planes->ny[i]))),
+                _mm256_mul_ps(Dz, _mm256_set1_ps(planes->nz[i])));
+        distance = _mm256_div_ps(_mm256_set1_ps(p_dot_n), Rd_dot_n);
+        closer = _mm256_and_ps(_mm256_cmp_ps(Rd_dot_n, minus_eps, _CMP_LE_OQ), _mm256_cmp_ps(distance, closest, _CMP_LT_OQ));
+
+        closest  = _mm256_blendv_ps(closest, distance, closer);
+        plane_id = _mm256_blendv_ps(plane_id, _mm256_castsi256_ps(_mm256_set1_epi32(i)), closer);
+    }
+
+    _mm256_store_ps(packet->closest_distance, closest);
+    _mm256_store_ps((f32*)packet->plane_id, plane_id);
+}
+
+TARGET_AVX2 void getSphereCandidatesPacketAVX2(NodesSoA *spheres, GeometryIds *sphere_ids, vec3 *Ro, RayPacket *packet, u8 *lanes) {
+    u16 i;
+    __m256 Cx, Cy, Cz, t, Ix, Iy, Iz, dt;
+    __m256 Dx = _mm256_load_ps(packet->Dx),
+           Dy = _mm256_load_ps(packet->Dy),
+           Dz = _mm256_load_ps(packet->Dz),
+           closest = _mm256_load_ps(packet->closest_distance),
+           zero = _mm256_setzero_ps();
+    closest = _mm256_mul_ps(closest, closest);
+
+    for (u16 k = 0; k < sphere_ids->count; k++) {
+        i = sphere_ids->ids[k];
+        Cx = _mm256_set1_ps(spheres->x[i] - Ro->x);
+        Cy = _mm256_set1_ps(spheres->y[i] - Ro->y);
+        Cz = _mm256_set1_ps(spheres->z[i] - Ro->z);
+
+        t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Cx, Dx), _mm256_mul_ps(Cy, Dy)), _mm256_mul_ps(Cz, Dz));
+        Ix = _mm256_sub_ps(_mm256_mul_ps(Dx, t), Cx);
+        Iy = _mm256_sub_ps(_mm256_mul_ps(Dy, t), Cy);
+        Iz = _mm256_sub_ps(_mm256_mul_ps(Dz, t), Cz);
+        dt = _mm256_sub_ps(_mm256_set1_ps(spheres->r[i] * spheres->r[i]),
+                _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Ix, Ix), _mm256_mul_ps(Iy, Iy)), _mm256_mul_ps(Iz, Iz)));
+
+        lanes[k] = (u8)_mm256_movemask_ps(_mm256_and_ps(_mm256_and_ps(
+                _mm256_cmp_ps(t, zero, _CMP_GT_OQ),
+                _mm256_cmp_ps(dt, zero, _CMP_GT_OQ)),
+                _mm256_cmp_ps(dt, closest, _CMP_LT_OQ)));
+    }
+}
+
+TARGET_AVX2 void getConvexCandidatesPacketAVX2(NodesSoA *nodes, FacesSoA *faces, u8 face_count, GeometryIds *ids, vec3 *Ro, RayPacket *packet, u8 *lanes) {
+    u32 face_id;
+    u16 i;
+    f32 margin;
+    __m256 Cx, Cy, Cz, t, Ix, Iy, Iz, p_dot_n, Rd_dot_n, distance, enter, exit, candidate;
+    __m256 Dx = _mm256_load_ps(packet->Dx),
+           Dy = _mm256_load_ps(packet->Dy),
+           Dz = _mm256_load_ps(packet->Dz),
+           closest = _mm256_load_ps(packet->closest_distance),
+           zero = _mm256_setzero_ps(),
+           min_distance = _mm256_set1_ps(-MAX_DISTANCE),
+           max_distance = _mm256_set1_ps(MAX_DISTANCE);
+
+    for (u16 k = 0; k < ids->count; k++) {
+        i = ids->ids[k];
+        Cx = _mm256_set1_ps(nodes->x[i] - Ro->x);
+        Cy = _mm256_set1_ps(nodes->y[i] - Ro->y);
+        Cz = _mm256_set1_ps(nodes->z[i] - Ro->z);
+        margin = nodes->r[i] * CONVEX_CANDIDATE_MARGIN;
+
+        t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Cx, Dx), _mm256_mul_ps(Cy, Dy)), _mm256_mul_ps(Cz, Dz));
+        Ix = _mm256_sub_ps(_mm256_mul_ps(Dx, t), Cx);
+        Iy = _mm256_sub_ps(_mm256_mul_ps(Dy, t), Cy);
+        Iz = _mm256_sub_ps(_mm256_mul_ps(Dz, t), Cz);
+        candidate = _mm256_cmp_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Ix, Ix), _mm256_mul_ps(Iy, Iy)), _mm256_mul_ps(Iz, Iz)),
+                _mm256_set1_ps((nodes->r[i] + margin) * (nodes->r[i] + margin)), _CMP_LT_OQ);
+
+        lanes[k] = 0;
+        if (!_mm256_movemask_ps(candidate)) continue;
+
+        enter = min_distance;
+        exit = max_distance;
+        face_id = (u32)i * face_count;
+        for (u8 f = 0; f < face_count; f++, face_id++) {
+            p_dot_n = _mm256_set1_ps(getPlaneDistancePacket(faces, (i32)face_id, Ro) + margin);
+            Rd_dot_n = _mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(Dx, _mm256_set1_ps(faces->nx[face_id])),
+                    _mm256_mul_ps(Dy, _mm256_set1_ps(faces->ny[face_id]))),
+                    _mm256_mul_ps(Dz, _mm256_set1_ps(faces->nz[face_id])));
+            distance = _mm256_div_ps(p_dot_n, Rd_dot_n);
+            enter = _mm256_max_ps(enter, _mm256_blendv_ps(min_distance, distance, _mm256_cmp_ps(Rd_dot_n, zero, _CMP_LT_OQ)));
+            exit  = _mm256_min_ps(exit,  _mm256_blendv_ps(max_distance, distance, _mm256_cmp_ps(Rd_dot_n, zero, _CMP_GT_OQ)));
+        }
+
+        lanes[k] = (u8)_mm256_movemask_ps(_mm256_and_ps(_mm256_and_ps(candidate,
+                _mm256_cmp_ps(exit, zero, _CMP_GT_OQ)),
+                _mm256_and_ps(_mm256_cmp_ps(enter, exit, _CMP_LE_OQ), _mm256_cmp_ps(enter, closest, _CMP_LT_OQ))));
+    }
+}
+
+bool cpuSupportsAVX2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+    __cpuidex(info, 7, 0);
+    return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+void initPacketKernels() {
+    packet_kernels.hitPlanes = hitPlanesPacketScalar;
+    packet_kernels.getSphereCandidates = getSphereCandidatesPacketScalar;
+    packet_kernels.getConvexCandidates = getConvexCandidatesPacketScalar;
+#ifdef PACKET_SIMD
+    if (cpuSupportsAVX2()) {
+        packet_kernels.hitPlanes = hitPlanesPacketAVX2;
+        packet_kernels.getSphereCandidates = getSphereCandidatesPacketAVX2;
+        packet_kernels.getConvexCandidates = getConvexCandidatesPacketAVX2;
+    } else {
+        packet_kernels.hitPlanes = hitPlanesPacketSSE;
+        packet_kernels.getSphereCandidates = getSphereCandidatesPacketSSE;
+        packet_kernels.getConvexCandidates = getConvexCandidatesPacketSSE;
+    }
+#endif
+}
+
+// Traces the primary rays of lane_count pixels of row y (x_step columns apart, from column x) against the tile's geometry:
+void tracePrimaryPacket(Ray *rays, u8 lane_count, Scene *scene, GeometryBounds *bounds, Masks *scene_masks, TileGeometry *tile, u16 x, u16 y, u8 x_step) {
+    RayPacket packet;
+    Ray *ray;
+    vec3 *Rd;
+    u16 i, k;
+    u8 lane_bit;
+    u32 test_count = PLANE_COUNT * lane_count;
+    f32 closest_distance_squared;
+
+    for (u8 lane = 0; lane < PACKET_WIDTH; lane++) {
+        Rd = rays[lane < lane_count ? lane : lane_count - 1].direction;
+        packet.Dx[lane] = Rd->x;
+        packet.Dy[lane] = Rd->y;
+        packet.Dz[lane] = Rd->z;
+        packet.closest_distance[lane] = MAX_DISTANCE;
+        packet.plane_id[lane] = -1;
+    }
+
+    packet_kernels.hitPlanes(&scene->soa->planes, rays->origin, &packet);
+    if (tile->spheres.count)
+        packet_kernels.getSphereCandidates(&scene->soa->spheres, &tile->spheres, rays->origin, &packet, tile->sphere_lanes);
+    if (tile->cubes.count)
+        packet_kernels.getConvexCandidates(&scene->soa->cubes, &scene->soa->cube_faces, 6, &tile->cubes, rays->origin, &packet, tile->cube_lanes);
+    if (tile->tetrahedra.count)
+        packet_kernels.getConvexCandidates(&scene->soa->tetrahedra, &scene->soa->tetrahedron_faces, 4, &tile->tetrahedra, rays->origin, &packet, tile->tetrahedron_lanes);
+
+    ray = rays;
+    lane_bit = 1;
+    for (u8 lane = 0; lane < lane_count; lane++, ray++, x += x_step, lane_bit <<= 1) {
+        ray->hit.uv.x = ray->hit.uv.y = 1;
+        ray->hit.distance = MAX_DISTANCE;
+
+        if (packet.plane_id[lane] >= 0)
+            setRayPlaneHit(ray, scene->planes + packet.plane_id[lane], packet.closest_distance[lane]);
+
+        closest_distance_squared = ray->hit.distance * ray->hit.distance;
+        for (k = 0; k < tile->spheres.count; k++) {
+            i = tile->spheres.ids[k];
+            if (tile->sphere_lanes[k] & lane_bit && isInBounds(bounds->spheres + i, x, y)) {
+                hitSphere(scene->spheres + i, ray, closest_distance_squared, testBit(scene_masks->transparency.spheres, i) != 0);
+                test_count++;
+            }
+        }
+
+        for (k = 0; k < tile->cubes.count; k++) {
+            i = tile->cubes.ids[k];
+            if (tile->cube_lanes[k] & lane_bit && isInBounds(bounds->cubes + i, x, y)) {
+                hitCube(scene->cubes + i, scene->cube_indices, ray, false);
+                test_count++;
+            }
+        }
+
+        for (k = 0; k < tile->tetrahedra.count; k++) {
+            i = tile->tetrahedra.ids[k];
+            if (tile->tetrahedron_lanes[k] & lane_bit && isInBounds(bounds->tetrahedra + i, x, y)) {
+                hitTetrahedron(scene->tetrahedra + i, scene->tetrahedron_indices, ray, false);
+                test_count++;
+            }
+        }
+
+        for (k = 0; k < tile->meshes.count; k++) {
+            i = tile->meshes.ids[k];
+            if (isInBounds(bounds->meshes + i, x, y))
+                hitMesh(scene->meshes + i, ray, false);
+        }
+    }
+
+    countRays(primary_rays, lane_count);
+    countRays(primitive_tests, test_count);
+}
\ No newline at end of file
@@ -21,18 +21,30 @@ __forceinline__
 #else
 inline
 #endif
-void renderBeauty(Ray *ray, Scene *scene, BVHNode *bvh_nodes, GeometryBounds *bounds, Masks *masks, u16 x, u16 y, Pixel* pixel) {
-    tracePrimaryRay(ray, scene, bounds, masks, x, y);
+void shadeBeautyColor(Ray *ray, Scene *scene, BVHNode *bvh_nodes, Masks *masks, vec3 *color) {
+    fillVec3(color, 0);
+//    shadeReflection(scene, bvh_nodes, masks, ray->hit.material_id, ray->direction,  &ray->hit.position, &ray->hit.normal, 0, color);
+    shadeSurface(scene, bvh_nodes, masks, ray->hit.material_id, ray->direction,  &ray->hit.position, &ray->hit.normal, color);
+//    shadeLambert(scene, bvh_nodes, masks, ray->direction, &ray->hit.position, &ray->hit.normal, color);
+//    shadePhong(scene, bvh_nodes, masks, ray->direction, &ray->hit.position, &ray->hit.normal, color);
+//    shadeBlinn(scene, bvh_nodes, masks, ray->direction, &ray->hit.position, &ray->hit.normal, color);
+    color->x = toneMappedBaked(color->x);
+    color->y = toneMappedBaked(color->y);
+    color->z = toneMappedBaked(color->z);
+//    color->x = gammaCorrected(color->x);
+//    color->y = gammaCorrected(color->y);
+//    color->z = gammaCorrected(color->z);
+}
 
-    vec3 color;
-    fillVec3(&color, 0);
-//    shadeReflection(scene, bvh_nodes, masks, ray->hit.material_id, ray->direction,  &ray->hit.position, &ray->hit.normal, 0, &color);
-    shadeSurface(scene, bvh_nodes, masks, ray->hit.material_id, ray->direction,  &ray->hit.position, &ray->hit.normal, &color);
-//    shadeLambert(scene, bvh_nodes, masks, ray->direction, &ray->hit.position, &ray->hit.normal, &color);
-//    shadePhong(scene, bvh_nodes, masks, ray->direction, &ray->hit.position, &ray->hit.normal, &color);
-//    shadeBlinn(scene, bvh_nodes, masks, ray->direction, &ray->hit.position, &ray->hit.normal, &color);
-    setPixelBakedToneMappedColor(pixel, color);
-//    setPixelGammaCorrectedColor(pixel, color);
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void shadeNormalsColor(Ray *ray, Scene *scene, BVHNode *bvh_nodes, Masks *masks, vec3 *color) {
+    shadeDirection(&ray->hit.normal, color);
 }
 
 #ifdef __CUDACC__
@@ -42,11 +54,31 @@ __forceinline__
 #else
 inline
 #endif
-void renderNormals(Ray *ray, Scene *scene, BVHNode *bvh_nodes, GeometryBounds *bounds, Masks *masks, u16 x, u16 y, Pixel* pixel) {
-    tracePrimaryRay(ray, scene, bounds, masks, x, y);
+void shadeDepthColor(Ray *ray, Scene *scene, BVHNode *bvh_nodes, Masks *masks, vec3 *color) {
+    shadeDepth(ray->hit.distance, color);
+}
+
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void shadeUVsColor(Ray *ray, Scene *scene, BVHNode *bvh_nodes, Masks *masks, vec3 *color) {
+    shadeUV(ray->hit.uv, color);
+}
 
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void shadeBeautyPixel(Ray *ray, Scene *scene, BVHNode *bvh_nodes, Masks *masks, Pixel* pixel) {
     vec3 color;
-    shadeDirection(&ray->hit.normal, &color);
+    shadeBeautyColor(ray, scene, bvh_nodes, masks, &color);
     setPixelColor(pixel, color);
 }
 
@@ -57,11 +89,9 @@ __forceinline__
 #else
 inline
 #endif
-void renderDepth(Ray *ray, Scene *scene, BVHNode *bvh_nodes, GeometryBounds *bounds, Masks *masks, u16 x, u16 y, Pixel* pixel) {
-    tracePrimaryRay(ray, scene, bounds, masks, x, y);
-
+void shadeNormalsPixel(Ray *ray, Scene *scene, BVHNode *bvh_nodes, Masks *masks, Pixel* pixel) {
     vec3 color;
-    shadeDepth(ray->hit.distance, &color);
+    shadeNormalsColor(ray, scene, bvh_nodes, masks, &color);
     setPixelColor(pixel, color);
 }
 
@@ -72,10 +102,69 @@ __forceinline__
 #else
 inline
 #endif
-void renderUVs(Ray *ray, Scene *scene, BVHNode *bvh_nodes, GeometryBounds *bounds, Masks *masks, u16 x, u16 y, Pixel* pixel) {
-    tracePrimaryRay(ray, scene, bounds, masks, x, y);
+void shadeDepthPixel(Ray *ray, Scene *scene, BVHNode *bvh_nodes, Masks *masks, Pixel* pixel) {
+    vec3 color;
+    shadeDepthColor(ray, scene, bvh_nodes, masks, &color);
+    setPixelColor(pixel, color);
+}
 
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void shadeUVsPixel(Ray *ray, Scene *scene, BVHNode *bvh_nodes, Masks *masks, Pixel* pixel) {
     vec3 color;
-    shadeUV(ray->hit.uv, &color);
+    shadeUVsColor(ray, scene, bvh_nodes, masks, &color);
     setPixelColor(pixel, color);
+}
+
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void renderBeauty(Ray *ray, Scene *scene, BVHNode *bvh_nodes, GeometryBounds *bounds, Masks *masks, u16 x, u16 y, Pixel* pixel) {
+    tracePrimaryRay(ray, scene, bounds, masks, x, y);
+    shadeBeautyPixel(ray, scene, bvh_nodes, masks, pixel);
+}
+
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void renderNormals(Ray *ray, Scene *scene, BVHNode *bvh_nodes, GeometryBounds *bounds, Masks *masks, u16 x, u16 y, Pixel* pixel) {
+    tracePrimaryRay(ray, scene, bounds, masks, x, y);
+    shadeNormalsPixel(ray, scene, bvh_nodes, masks, pixel);
+}
+
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void renderDepth(Ray *ray, Scene *scene, BVHNode *bvh_nodes, GeometryBounds *bounds, Masks *masks, u16 x, u16 y, Pixel* pixel) {
+    tracePrimaryRay(ray, scene, bounds, masks, x, y);
+    shadeDepthPixel(ray, scene, bvh_nodes, masks, pixel);
+}
+
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+void renderUVs(Ray *ray, Scene *scene, BVHNode *bvh_nodes, GeometryBounds *bounds, Masks *masks, u16 x, u16 y, Pixel* pixel) {
+    tracePrimaryRay(ray, scene, bounds, masks, x, y);
+    shadeUVsPixel(ray, scene, bvh_nodes, masks, pixel);
 }
\ No newline at end of file
@@ -5,11 +5,13 @@
 #include "lib/globals/scene.h"
 #include "lib/globals/raytracing.h"
 #include "lib/render/BVH.h"
+#include "lib/render/SSB.h"
 
 #include "intersection/tetrahedra.h"
 #include "intersection/sphere.h"
 #include "intersection/plane.h"
 #include "intersection/cube.h"
+#include "intersection/mesh.h"
 #include "intersection/AABB.h"
 
 #ifdef __CUDACC__
@@ -20,21 +22,91 @@ __forceinline__
 inline
 #endif
 void tracePrimaryRay(Ray *ray, Scene *scene, GeometryBounds *bounds, Masks *scene_masks, u16 x, u16 y) {
+    countRays(primary_rays, 1);
     ray->hit.uv.x = ray->hit.uv.y = 1;
     ray->hit.distance = MAX_DISTANCE;
 
-    u8 visibility;
-
     hitPlanes(scene->planes, ray);
+    countIntersectionTests(PLANE_COUNT);
+
+    f32 closest_distance_squared = ray->hit.distance * ray->hit.distance;
+    for (u16 i = 0; i < scene->sphere_count; i++)
+        if (testBit(scene_masks->visibility.spheres, i) && isInBounds(bounds->spheres + i, x, y)) {
+            hitSphere(scene->spheres + i, ray, closest_distance_squared, testBit(scene_masks->transparency.spheres, i) != 0);
+            countIntersectionTests(1);
+        }
+
+    for (u16 i = 0; i < scene->cube_count; i++)
+        if (testBit(scene_masks->visibility.cubes, i) && isInBounds(bounds->cubes + i, x, y)) {
+            hitCube(scene->cubes + i, scene->cube_indices, ray, false);
+            countIntersectionTests(1);
+        }
+
+    for (u16 i = 0; i < scene->tetrahedron_count; i++)
+        if (testBit(scene_masks->visibility.tetrahedra, i) && isInBounds(bounds->tetrahedra + i, x, y)) {
+            hitTetrahedron(scene->tetrahedra + i, scene->tetrahedron_indices, ray, false);
+            countIntersectionTests(1);
+        }
+
+    for (u16 i = 0; i < scene->mesh_count; i++)
+        if (testBit(scene_masks->visibility.meshes, i) && isInBounds(bounds->meshes + i, x, y))
+            hitMesh(scene->meshes + i, ray, false);
+}
 
-    visibility = getVisibilityMasksFromBounds(bounds->spheres, SPHERE_COUNT, scene_masks->visibility.spheres, x, y);
-    if (visibility) hitSpheres(scene->spheres, ray, visibility, scene_masks->transparency.spheres, false);
-
-    visibility = getVisibilityMasksFromBounds(bounds->cubes, CUBE_COUNT, scene_masks->visibility.cubes, x, y);
-    if (visibility) hitCubes(scene->cubes, scene->cube_indices, ray, visibility, false);
+// Intersects the ray against the geometry of the BVH leaves it passes through (only the geometry in the given mask).
+// Unless check_any is set, the ray ends up with the closest hit:
+#ifdef __CUDACC__
+__device__
+__host__
+__forceinline__
+#else
+inline
+#endif
+bool hitGeometryInBVH(Ray *ray, Scene *scene, BVHNode *bvh_nodes, GeometryMasks *mask, GeometryMasks *transparency, bool check_any) {
+    BVHNode *node;
+    u32 stack[MAX_BVH_DEPTH];
+    u8 stack_size = 1;
+    u16 id;
+    bool found = false;
+    if (!bvh_nodes) return false; // Scenes without geometry have no BVH (see initBVH)
+
+    stack[0] = 0;
+    while (stack_size) { // Depth-first traversal
+        node = &bvh_nodes[stack[--stack_size]];
+        countRayCost(CostBVHNodesVisited, 1);
+        if (!hitAABB(&node->aabb.min, &node->aabb.max, ray->origin, ray->direction_rcp)) continue;
+
+        if (node->left_child) {
+            stack[stack_size++] = node->left_child + 1;
+            stack[stack_size++] = node->left_child;
+            continue;
+        }
+
+        id = node->geo_id;
+        switch (node->geo_type) {
+            case GeoTypeCube:
+                if (!testBit(mask->cubes, id)) break;
+                countIntersectionTests(1);
+                if (hitCube(scene->cubes + id, scene->cube_indices, ray, check_any)) found = true;
+                break;
+            case GeoTypeSphere:
+                if (!testBit(mask->spheres, id)) break;
+                countIntersectionTests(1);
+                if (hitSphere(scene->spheres + id, ray, ray->hit.distance * ray->hit.distance, testBit(transparency->spheres, id) != 0)) found = true;
+                break;
+            case GeoTypeTetrahedron:
+                if (!testBit(mask->tetrahedra, id)) break;
+                countIntersectionTests(1);
+                if (hitTetrahedron(scene->tetrahedra + id, scene->tetrahedron_indices, ray, check_any)) found = true;
+                break;
+            case GeoTypeMesh:
+                if (testBit(mask->meshes, id) && hitMesh(scene->meshes + id, ray, check_any)) found = true;
+                break;
+        }
+        if (found && check_any) break;
+    }
 
-    visibility = getVisibilityMasksFromBounds(bounds->tetrahedra, TETRAHEDRON_COUNT, scene_masks->visibility.tetrahedra, x, y);
-    if (visibility) hitTetrahedra(scene->tetrahedra, scene->tetrahedron_indices, ray, visibility, false);
+    return found;
 }
 
 #ifdef __CUDACC__
@@ -48,25 +120,9 @@ void traceSecondaryRay(Ray *ray, Scene *scene, BVHNode *bvh_nodes, Masks *scene_
     ray->hit.uv.x = ray->hit.uv.y = 1;
     ray->hit.distance = MAX_DISTANCE;
 
-    vec3 Rd_rcp;
-    Rd_rcp.x = 1.0f / ray->direction->x;
-    Rd_rcp.y = 1.0f / ray->direction->y;
-    Rd_rcp.z = 1.0f / ray->direction->z;
-
-//    if (!hitAABB(&bvh_nodes->aabb.min, &bvh_nodes->aabb.max, Ro, &Rd_rcp))
-//        return false;
-
-
     hitPlanes(scene->planes, ray);
-    GeometryMasks visibility = getRayVisibilityMasksFromBVH(ray->origin, &Rd_rcp, bvh_nodes);
-
-    visibility.cubes &= scene_masks->visibility.cubes;
-    visibility.spheres &= scene_masks->visibility.spheres;
-    visibility.tetrahedra &= scene_masks->visibility.tetrahedra;
-
-    if (visibility.spheres) hitSpheres(scene->spheres, ray, visibility.spheres, scene_masks->transparency.spheres, true);
-    if (visibility.cubes) hitCubes(scene->cubes, scene->cube_indices, ray, visibility.cubes, true);
-    if (visibility.tetrahedra) hitTetrahedra(scene->tetrahedra, scene->tetrahedron_indices, ray, visibility.tetrahedra, true);
+    countIntersectionTests(PLANE_COUNT);
+    hitGeometryInBVH(ray, scene, bvh_nodes, &scene_masks->visibility, &scene_masks->transparency, false);
 }
 
 
@@ -78,40 +134,20 @@ __forceinline__
 inline
 #endif
 bool inShadow(Scene *scene, BVHNode *bvh_nodes, Masks *scene_masks, vec3* Rd, vec3* Ro, f32 light_distance) {
-    vec3 Rd_rcp;
-    Rd_rcp.x = 1.0f / Rd->x;
-    Rd_rcp.y = 1.0f / Rd->y;
-    Rd_rcp.z = 1.0f / Rd->z;
-
-//    if (!hitAABB(&bvh_nodes->aabb.min, &bvh_nodes->aabb.max, Ro, &Rd_rcp))
-//        return false;
+    countRayCost(CostShadowRays, 1);
+    countRays(shadow_rays, 1);
 
-    GeometryMasks visibility = getRayVisibilityMasksFromBVH(Ro, &Rd_rcp, bvh_nodes);
-    visibility.cubes &= scene_masks->shadowing.cubes;
-    visibility.spheres &= scene_masks->shadowing.spheres;
-    visibility.tetrahedra &= scene_masks->shadowing.tetrahedra;
-    if (!(visibility.cubes | visibility.spheres | visibility.tetrahedra))
-        return false;
+    vec3 Rd_rcp;
+    reciprocalVec3(Rd, &Rd_rcp);
 
     Ray ray;
     ray.origin = Ro;
     ray.direction = Rd;
+    ray.direction_rcp = &Rd_rcp;
     ray.hit.distance = light_distance;
 
-    if (visibility.spheres) {
-        if (hitSpheres(scene->spheres, &ray, visibility.spheres, scene_masks->transparency.spheres, true))
-            return true;
-    }
-
-    if (visibility.cubes) {
-        if (hitCubes(scene->cubes, scene->cube_indices, &ray, visibility.cubes, true))
-            return true;
-    }
-
-    if (visibility.tetrahedra) {
-        if (hitTetrahedra(scene->tetrahedra, scene->tetrahedron_indices, &ray, visibility.tetrahedra, true))
-            return true;
-    }
+    bool found = hitGeometryInBVH(&ray, scene, bvh_nodes, &scene_masks->shadowing, &scene_masks->transparency, true);
+    if (found) countRays(any_hits, 1);
 
-    return false;
+    return found;
 }
\ No newline at end of file
@@ -27,7 +27,7 @@ inline bool inBounds(Bounds2Di *bounds, vec2i pos) {
 inline void drawHLine2D(i32 from, i32 to, i32 at, Pixel pixel) {
 	if (!inRange(at, frame_buffer.dimentions.height, 0)) return;
 
-	i32 offset = at * (i32)frame_buffer.dimentions.width;
+	i32 offset = at * (i32)frame_buffer.stride;
     i32 first, last;
     subRange(from, to, frame_buffer.dimentions.width, 0, &first, &last);
 	first += offset;
@@ -40,9 +40,9 @@ inline void drawVLine2D(i32 from, i32 to, i32 at, Pixel pixel) {
     i32 first, last;
 
     subRange(from, to, frame_buffer.dimentions.height, 0, &first, &last);
-	first *= frame_buffer.dimentions.width; first += at;
-	last  *= frame_buffer.dimentions.width; last  += at;
-	for (i32 i = first; i <= last; i += frame_buffer.dimentions.width) frame_buffer.pixels[i] = pixel;
+	first *= frame_buffer.stride; first += at;
+	last  *= frame_buffer.stride; last  += at;
+	for (i32 i = first; i <= last; i += frame_buffer.stride) frame_buffer.pixels[i] = pixel;
 }
 
 inline void drawLine2D(i32 x0, i32 y0, i32 x1, i32 y1, Pixel pixel) {
@@ -65,7 +65,7 @@ inline void drawLine2D(i32 x0, i32 y0, i32 x1, i32 y1, Pixel pixel) {
 	i32 width = (i32)frame_buffer.dimentions.width;
 	i32 height = (i32)frame_buffer.dimentions.height;
 
-    i32 pitch = width;
+    i32 pitch = (i32)frame_buffer.stride;
 	i32 index = x0 + y0 * pitch;
 
     i32 run  = x1 - x0;
@@ -108,7 +108,7 @@ inline void drawLine2D(i32 x0, i32 y0, i32 x1, i32 y1, Pixel pixel) {
     while (current1 != end) {
         current1 += inc1;
 
-        if (inRange(index, frame_buffer.dimentions.width_times_height, 0)) {
+        if (inRange(index, frame_buffer.size, 0)) {
             if (is_steap) {
                 if (inRange(current1, height, 0) &&
                     inRange(current2, width, 0))
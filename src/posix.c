@@ -0,0 +1,247 @@
+#define _GNU_SOURCE
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lib/core/perf.h"
+#include "lib/input/mouse.h"
+#include "lib/input/keyboard.h"
+#include "lib/engine.h"
+
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+#define DEFAULT_FRAME_COUNT 100
+
+void Posix_printDebugString(char* str) { fputs(str, stderr); }
+void Posix_updateWindowTitle() {}
+u64 Posix_getTicks() {
+    struct timespec monotonic_time;
+    clock_gettime(CLOCK_MONOTONIC, &monotonic_time);
+    return (u64)monotonic_time.tv_sec * 1000000000ULL + (u64)monotonic_time.tv_nsec;
+}
+
+// Maps the scene file copy-on-write, so the scene can be edited in place without touching the file:
+bool Posix_mapSceneFile(char *path) {
+    int file = open(path, O_RDONLY);
+    if (file == -1)
+        return false;
+
+    struct stat file_stat;
+    void *data = MAP_FAILED;
+    if (!fstat(file, &file_stat) && file_stat.st_size > 0)
+        data = mmap(0, (size_t)file_stat.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+        return false;
+
+    scene_file.data = (u8*)data;
+    scene_file.size = (u64)file_stat.st_size;
+    return true;
+}
+
+bool Posix_saveSceneFile(char *path) {
+    MemoryMarker marker = saveMemory(&memory);
+    u64 size = writeSceneFile(&main_scene, &ray_tracer.bvh, 0);
+    u8 *data = AllocN(u8, size);
+    if (!data)
+        return false;
+    writeSceneFile(&main_scene, &ray_tracer.bvh, data);
+
+    FILE *file = fopen(path, "wb");
+    bool is_written = file && fwrite(data, 1, size, file) == size;
+    if (file && fclose(file)) is_written = false;
+    restoreMemory(&memory, marker);
+    return is_written;
+}
+
+enum RenderMode parseRenderMode(char *name) {
+    if (!strcmp(name, "normals")) return Normals;
+    if (!strcmp(name, "depth"))   return Depth;
+    if (!strcmp(name, "uvs"))     return UVs;
+    if (!strcmp(name, "cost"))    return Cost;
+    return Beauty;
+}
+
+bool isOBJFile(char *path) {
+    size_t length = strlen(path);
+    return length > 4 && !strcmp(path + length - 4, ".obj");
+}
+
+// Printed for --help, and for options that are not known or lack their value:
+static char *usage =
+    "Usage: posix [width] [height] [frame_count] [beauty|normals|depth|uvs|cost] [worker_count] [scene_file] [mesh.obj...]\n"
+    "       posix --save-scene scene_file [mesh.obj...] (writes the demo scene, along with its BVH)\n"
+    "Options preceding the above:\n"
+    "       --trace trace_file (records the timed frames into a Chrome trace)\n"
+    "       --dump-cost csv_file (writes the per-pixel counts of the last frame, when rendering in the cost mode)\n"
+    "       --huge-pages transparent|explicit (backs the per-pixel buffers and large meshes with huge pages)\n"
+    "       --full-frames (traces every tile of every frame, instead of only the ones that changed)\n"
+    "       --checkerboard (traces half of the pixels of each frame, reconstructing the others)\n"
+    "       --target-frame-time milliseconds (scales the render resolution to take about as long)\n"
+    "Sizes that are missing or not numbers default to 1920x1080, OBJ files are imported into the demo scene\n"
+    "(so they are ignored when a scene file is given).\n";
+
+int main(int argc, char **argv) {
+    char *trace_file = 0, *cost_file = 0;
+    while (argc > 1) {
+        // Options without a value:
+        bool is_flag = true;
+        if      (!strcmp(argv[1], "--full-frames"))  render_changes_only = false;
+        else if (!strcmp(argv[1], "--checkerboard")) checkerboard_rendering = true;
+        else is_flag = false;
+        if (is_flag) {
+            argv++;
+            argc--;
+            continue;
+        }
+
+        if (argc < 3) break;
+        if      (!strcmp(argv[1], "--trace"))     trace_file = argv[2];
+        else if (!strcmp(argv[1], "--dump-cost")) cost_file  = argv[2];
+        else if (!strcmp(argv[1], "--huge-pages"))
+            huge_pages = !strcmp(argv[2], "explicit") ? HugePagesExplicit : HugePagesTransparent;
+        else if (!strcmp(argv[1], "--target-frame-time")) dynamic_resolution.target_milliseconds = (f32)atof(argv[2]);
+        else break;
+
+        argv += 2;
+        argc -= 2;
+    }
+
+    bool save_scene = argc > 2 && !strcmp(argv[1], "--save-scene");
+    if (argc > 1 && !save_scene && !strncmp(argv[1], "--", 2)) {
+        bool is_help = !strcmp(argv[1], "--help");
+        fputs(usage, is_help ? stdout : stderr);
+        return is_help ? 0 : -1;
+    }
+
+    u32 width       = argc > 1 && !save_scene ? (u32)atoi(argv[1]) : DEFAULT_WIDTH;
+    u32 height      = argc > 2 && !save_scene ? (u32)atoi(argv[2]) : DEFAULT_HEIGHT;
+    u32 frame_count = argc > 3 && !save_scene ? (u32)atoi(argv[3]) : DEFAULT_FRAME_COUNT;
+    if (!width)  width  = DEFAULT_WIDTH;
+    if (!height) height = DEFAULT_HEIGHT;
+    if (width  > MAX_WIDTH)  width  = MAX_WIDTH;
+    if (height > MAX_HEIGHT) height = MAX_HEIGHT;
+    if (!frame_count) frame_count = DEFAULT_FRAME_COUNT;
+
+    // Initialize the memory:
+    void *memory_address = reserveMemory(0, MEMORY_SIZE);
+    if (!memory_address)
+        return -1;
+    initReservedMemory(&memory, memory_address, MEMORY_SIZE);
+
+    u32 first_mesh_arg = save_scene ? 3 : 6;
+    if (argc > 5 && !save_scene) worker_pool.worker_count = (u32)atoi(argv[5]);
+    if (argc > 6 && !save_scene && !isOBJFile(argv[6])) {
+        if (!Posix_mapSceneFile(argv[6])) {
+            fprintf(stderr, "Could not map scene file: %s\n", argv[6]);
+            return -1;
+        }
+        first_mesh_arg = 7;
+    }
+    if ((u32)argc > first_mesh_arg) {
+        mesh_files.paths = argv + first_mesh_arg;
+        mesh_files.count = (u16)(argc - first_mesh_arg);
+    }
+
+    KeyMap key_map;
+    memset(&key_map, 0, sizeof(KeyMap));
+
+    initEngine(
+        Posix_updateWindowTitle,
+        Posix_printDebugString,
+        Posix_getTicks,
+        1000000000ULL,
+        key_map
+    );
+    if (save_scene) {
+        if (Posix_saveSceneFile(argv[2]))
+            return 0;
+
+        fprintf(stderr, "Could not write scene file: %s\n", argv[2]);
+        return -1;
+    }
+    if (argc > 4) render_mode = parseRenderMode(argv[4]);
+
+    // Every frame gets timed, including ones that would be skipped as nothing changed:
+    skip_unchanged_frames = false;
+
+    // Resizing renders one (warm-up) frame:
+    resize((u16)width, (u16)height);
+    profiler.is_enabled = true;
+    if (trace_file) startTraceRecording(worker_pool.worker_count);
+
+    RayStats *ray_stats = &ray_tracer.ray_stats;
+    RayCounts total_ray_counts;
+    memset(&total_ray_counts, 0, sizeof(RayCounts));
+    u64 ticks, min_ticks = (u64)-1, max_ticks = 0, total_ticks = 0, total_render_ticks = 0;
+    for (u32 frame = 0; frame < frame_count; frame++) {
+        ticks = getTicks();
+        updateAndRender();
+        ticks = getTicks() - ticks;
+
+        total_ticks += ticks;
+        total_render_ticks += ray_stats->frame_ticks;
+        addRayCounts(&ray_stats->frame, &total_ray_counts);
+        if (ticks < min_ticks) min_ticks = ticks;
+        if (ticks > max_ticks) max_ticks = ticks;
+        printf("frame %u: %.3f ms, %llu rays, %.2f Mrays/s, %u of %u tiles traced", frame, (f64)ticks * milliseconds_per_tick,
+               getRayCount(&ray_stats->frame),
+               (f64)getRayCount(&ray_stats->frame) / ((f64)ray_stats->frame_ticks * microseconds_per_tick),
+               render_changes_only ? ray_tracer.dirty_regions.tile_count : ray_tracer.tiles.count, ray_tracer.tiles.count);
+        if (dynamic_resolution.target_milliseconds) {
+            Dimentions *rendered = dynamic_resolution.scale < 1 ? &dynamic_resolution.frame_buffer.dimentions : &frame_buffer.dimentions;
+            printf(", next at %ux%u", rendered->width, rendered->height);
+        }
+        printf("\n");
+    }
+
+    f64 average_ticks = (f64)total_ticks / frame_count;
+    printf("%ux%u, %u frames: min %.3f ms, avg %.3f ms, max %.3f ms, %.2f FPS\n",
+           width, height, frame_count,
+           (f64)min_ticks * milliseconds_per_tick,
+           average_ticks  * milliseconds_per_tick,
+           (f64)max_ticks * milliseconds_per_tick,
+           ticks_per_second / average_ticks);
+
+    // Throughput is measured over the time spent rendering (excluding the rest of the frame):
+    printf("rays per frame: %llu primary, %llu shadow (%llu any-hits), %llu primitive tests, %.2f Mrays/s\n",
+           total_ray_counts.primary_rays    / frame_count,
+           total_ray_counts.shadow_rays     / frame_count,
+           total_ray_counts.any_hits        / frame_count,
+           total_ray_counts.primitive_tests / frame_count,
+           (f64)getRayCount(&total_ray_counts) / ((f64)total_render_ticks * microseconds_per_tick));
+
+    WorkerMemory *worker_memory = worker_memory_pool.workers;
+    for (u32 i = 0; i < worker_memory_pool.worker_count; i++, worker_memory++)
+        printf("worker %u memory: %llu allocations, %llu KB in %llu chunks in the last frame, peak %llu chunks, %llu overflows\n", i,
+               worker_memory->allocation_count,
+               worker_memory->allocated / 1024,
+               worker_memory->chunk_count,
+               worker_memory->peak_chunk_count,
+               worker_memory->overflow_count);
+
+    // Starting another frame ends the last one:
+    profileFrame();
+    updateProfileText();
+    fputs(profiler.text, stdout);
+
+    if (trace_file) {
+        stopTraceRecording();
+        if (!writeTrace(trace_file)) {
+            fprintf(stderr, "Could not write trace file: %s\n", trace_file);
+            return -1;
+        }
+    }
+
+    if (cost_file && !writeCostMap(cost_file)) {
+        fprintf(stderr, "Could not write cost counts (rendering in the cost mode?): %s\n", cost_file);
+        return -1;
+    }
+
+    return 0;
+}
@@ -29,15 +29,39 @@ static PUINT raw_input_size_ptr = (PUINT)(&raw_input_size);
 static UINT raw_input_header_size = sizeof(RAWINPUTHEADER);
 
 static u64 Win32_ticksPerSecond;
-static LARGE_INTEGER performance_counter;
 
 void Win32_printDebugString(char* str) { OutputDebugStringA(str); }
 void Win32_updateWindowTitle() { SetWindowTextA(window, getTitle()); }
 u64 Win32_getTicks() {
+    LARGE_INTEGER performance_counter;
     QueryPerformanceCounter(&performance_counter);
     return (u64)performance_counter.QuadPart;
 }
 
+// Maps the scene file copy-on-write, so the scene can be edited in place without touching the file:
+bool Win32_mapSceneFile(char *path) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    HANDLE mapping = 0;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, 0, PAGE_WRITECOPY, 0, 0, 0);
+    CloseHandle(file);
+    if (!mapping)
+        return false;
+
+    // The view keeps the mapping alive:
+    scene_file.data = (u8*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!scene_file.data)
+        return false;
+
+    scene_file.size = (u64)file_size.QuadPart;
+    return true;
+}
+
 inline UINT getRawInput(LPVOID data) {
     return GetRawInputData(raw_input_handle, RID_INPUT, data, raw_input_size_ptr, raw_input_header_size);
 }
@@ -67,14 +91,17 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             info.bmiHeader.biHeight = win_rect.top - win_rect.bottom;
 
             resize((u16)info.bmiHeader.biWidth, (u16)-info.bmiHeader.biHeight);
+            info.bmiHeader.biWidth = frame_buffer.stride; // The rows are padded (the window is drawn width pixels of each)
 
             break;
 
         case WM_PAINT:
+            profileBegin(ProfilePresent);
             SetDIBitsToDevice(win_dc,
                               0, 0, frame_buffer.dimentions.width, frame_buffer.dimentions.height,
                               0, 0, 0, frame_buffer.dimentions.height,
                               (u32*)frame_buffer.pixels, &info, DIB_RGB_COLORS);
+            profileEnd(ProfilePresent);
 
             ValidateRgn(window, NULL);
             break;
@@ -149,13 +176,18 @@ int APIENTRY WinMain(HINSTANCE hInstance,
                      LPSTR     lpCmdLine,
                      int       nCmdShow) {
     // Initialize the memory:
-    memory.address = (u8*)VirtualAlloc(
-            (LPVOID)MEMORY_BASE,
-            MEMORY_SIZE,
-            MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    initReservedMemory(&memory, reserveMemory((LPVOID)MEMORY_BASE, MEMORY_SIZE), MEMORY_SIZE);
     if (!memory.address)
         return -1;
 
+    // The command line is an optional scene file to load, or an OBJ file to import into the demo scene:
+    size_t command_line_length = lpCmdLine ? strlen(lpCmdLine) : 0;
+    if (command_line_length > 4 && !strcmp(lpCmdLine + command_line_length - 4, ".obj")) {
+        mesh_files.paths = &lpCmdLine;
+        mesh_files.count = 1;
+    } else if (command_line_length && !Win32_mapSceneFile(lpCmdLine))
+        Win32_printDebugString("Could not map the scene file\n");
+
     LARGE_INTEGER performance_frequency;
     QueryPerformanceFrequency(&performance_frequency);
     Win32_ticksPerSecond = (u64)performance_frequency.QuadPart;
@@ -177,10 +209,17 @@ int APIENTRY WinMain(HINSTANCE hInstance,
     key_map.toggle_GPU = 'G';
     key_map.toggle_SSB = '0';
     key_map.toggle_BVH = '9';
+    key_map.toggle_accumulation = 'P';
+    key_map.toggle_profiler     = 'O';
+    key_map.toggle_trace        = 'T';
+    key_map.toggle_dynamic_resolution = 'V';
+    key_map.toggle_checkerboard       = 'B';
     key_map.set_beauty = '1';
     key_map.set_normal = '2';
     key_map.set_depth  = '3';
     key_map.set_uvs    = '4';
+    key_map.set_cost   = '5';
+    key_map.cycle_cost_metric = 'C';
 
     initEngine(
         Win32_updateWindowTitle,
@@ -245,7 +284,9 @@ int APIENTRY WinMain(HINSTANCE hInstance,
             DispatchMessageA(&message);
         }
         updateAndRender();
-        InvalidateRgn(window, NULL, FALSE);
+        // When nothing changed the last frame stays presented (repainted as needed), until input comes in:
+        if (is_idle) WaitMessage();
+        else InvalidateRgn(window, NULL, FALSE);
     }
 
     return 0;// (int)message.wParam;